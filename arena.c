@@ -0,0 +1,103 @@
+/*
+ *  Scratch arena routines
+ *  Bump allocator for short-lived intermediate data
+ *
+ *  Allocations are carved sequentially out of large blocks and are
+ *  all released together by ArenaReset(), so temporaries cost a pointer
+ *  bump instead of a malloc()/free() pair each.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "arena.h"
+
+/**
+ * @file arena.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Initializes an empty arena; no memory is reserved until first use
+ *
+ * @param a Arena to initialize
+ */
+void ArenaInit(Arena *a)
+{
+  a->head = NULL;
+}
+
+/**
+ * @brief Allocates bytes from the arena, adding a block when the current one is full
+ *
+ * @param a Arena to allocate from
+ * @param bytes Number of bytes requested
+ * @return Pointer aligned to ARENA_ALIGN, valid until ArenaReset() or ArenaDestroy()
+ */
+void *ArenaAlloc(Arena *a, size_t bytes)
+{
+  bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  ArenaBlock *b = a->head;
+  if (b == NULL || b->used + bytes > b->size) {
+    size_t size = bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE;
+    b = (ArenaBlock *)aligned_alloc(ARENA_ALIGN, (sizeof(ArenaBlock) + size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+    assert(b != NULL);
+    b->size = size;
+    b->used = 0;
+    b->next = a->head;
+    a->head = b;
+  }
+  void *p = b->data + b->used;
+  b->used += bytes;
+  return p;
+}
+
+/**
+ * @brief Releases every allocation at once, keeping the largest block for reuse
+ *
+ * @param a Arena to reset
+ */
+void ArenaReset(Arena *a)
+{
+  ArenaBlock *keep = NULL;
+  ArenaBlock *b = a->head;
+  while (b != NULL) {
+    ArenaBlock *next = b->next;
+    if (keep == NULL || b->size > keep->size) {
+      if (keep != NULL)
+        free(keep);
+      keep = b;
+    }
+    else {
+      free(b);
+    }
+    b = next;
+  }
+  if (keep != NULL) {
+    keep->used = 0;
+    keep->next = NULL;
+  }
+  a->head = keep;
+}
+
+/**
+ * @brief Frees all memory held by the arena
+ *
+ * @param a Arena to destroy
+ */
+void ArenaDestroy(Arena *a)
+{
+  ArenaBlock *b = a->head;
+  while (b != NULL) {
+    ArenaBlock *next = b->next;
+    free(b);
+    b = next;
+  }
+  a->head = NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ *  arena header
+ *  Function prototypes, data, and constants for scratch arena module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// SCRATCH ARENA (bump allocator, released all at once)
+
+// Default size of each arena block
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Alignment of every allocation
+#define ARENA_ALIGN 16
+
+typedef struct arena_block {
+  struct arena_block * next;
+  size_t size;
+  size_t used;
+  _Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
+
+typedef struct arena {
+  ArenaBlock * head;
+} Arena;
+
+// arena methods
+void ArenaInit(Arena *a);
+void * ArenaAlloc(Arena *a, size_t bytes);
+void ArenaReset(Arena *a);
+void ArenaDestroy(Arena *a);
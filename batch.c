@@ -0,0 +1,251 @@
+/*
+ *  Batched small-matrix multiply routines
+ *  Multiplies many pairs of the same small shape at once
+ *
+ *  A pair of at most 4 x 4 matrices is too small for MatrixMultiply()
+ *  to use vector instructions: its inner loop runs at most four times.
+ *  A batch gathers up to size pairs of one shape (r x k by k x c) in
+ *  structure-of-arrays layout instead, element (i, j) of every pair's
+ *  operand stored contiguously, so the multiply loops over the pairs
+ *  innermost and the compiler vectorizes it across the batch (at -O3).
+ *  The products are then scattered into small matrices of their own,
+ *  blocks the consumer recycles once it has freed them (AllocSmallMatrix()).
+ *
+ *  A batch of a rare shape may fill slowly, so no pair waits in one for
+ *  longer than BATCH_MAX_WAIT_NS: BatchExpire(), which consumers call
+ *  between pairs, and BatchAdd(), when it starts a batch, multiply older
+ *  batches partly filled, and consumers flush their batches before they
+ *  wait for matrices.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "matrix.h"
+#include "latency.h"
+#include "batch.h"
+
+/**
+ * @file batch.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+#define BATCH_SHAPES (BATCH_MAX_DIM * BATCH_MAX_DIM * BATCH_MAX_DIM)
+
+/**
+ * @brief Pairs of one shape waiting to be multiplied
+ *
+ * Element (i, j) of pair p's left operand is a[(i * k + j) * size + p],
+ * and likewise for b and the product out.
+ */
+typedef struct bucket {
+  int n;          /**< pairs gathered */
+  long long since;  /**< when its first pair was added */
+  int *a, *b, *out;
+  Matrix **m1, **m2;
+  long long *taken;
+} Bucket;
+
+/**
+ * @brief Batches of one consumer, one bucket per shape
+ */
+struct batch {
+  int size;
+  int pending;      /**< pairs gathered in all buckets */
+  long long oldest; /**< since of the oldest bucket, or earlier */
+  Bucket buckets[BATCH_SHAPES];
+};
+
+/**
+ * @brief Creates empty batches of up to size pairs
+ *
+ * @param size Pairs per batch (1 to BATCH_MAX)
+ */
+Batch *BatchCreate(int size)
+{
+  assert(size >= 1 && size <= BATCH_MAX);
+  Batch *b = (Batch *)calloc(1, sizeof(Batch));
+  assert(b != NULL);
+  b->size = size;
+  return b;
+}
+
+/**
+ * @brief Whether a pair can be batched: compatible, dense and small enough
+ */
+int BatchFits(Matrix *m1, Matrix *m2)
+{
+  return m1->cols == m2->rows && m1->csr == NULL && m2->csr == NULL &&
+         m1->rows <= BATCH_MAX_DIM && m1->cols <= BATCH_MAX_DIM && m2->cols <= BATCH_MAX_DIM;
+}
+
+/**
+ * @brief Multiplies every pair of a bucket, across the batch dimension
+ *
+ * restrict tells the compiler the three arrays do not overlap, which it
+ * needs to vectorize the innermost loop.
+ */
+static void multiply(const int *restrict a, const int *restrict b, int *restrict out,
+                     int r, int k, int c, int n, int size)
+{
+  for (int i = 0; i < r; i++) {
+    for (int j = 0; j < c; j++) {
+      int *restrict o = out + (i * c + j) * size;
+      for (int p = 0; p < n; p++)
+        o[p] = 0;
+      for (int x = 0; x < k; x++) {
+        const int *restrict ap = a + (i * k + x) * size;
+        const int *restrict bp = b + (x * c + j) * size;
+        for (int p = 0; p < n; p++)
+          o[p] += ap[p] * bp[p];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Multiplies a bucket's pairs, hands each product to done and empties the bucket
+ */
+static void run(Batch *batch, int shape, BatchDone done, void *arg)
+{
+  Bucket *bk = &batch->buckets[shape];
+  int r = shape / (BATCH_MAX_DIM * BATCH_MAX_DIM) + 1;
+  int k = shape / BATCH_MAX_DIM % BATCH_MAX_DIM + 1;
+  int c = shape % BATCH_MAX_DIM + 1;
+  int size = batch->size;
+  multiply(bk->a, bk->b, bk->out, r, k, c, bk->n, size);
+
+  // Scatter the products into recycled blocks, whose elements are consecutive
+  for (int p = 0; p < bk->n; p++) {
+    Matrix *product = AllocSmallMatrix(r, c);
+    int *data = product->m[0];
+    for (int e = 0; e < r * c; e++)
+      data[e] = bk->out[e * size + p];
+    done(bk->m1[p], bk->m2[p], product, bk->taken[p], arg);
+  }
+  batch->pending -= bk->n;
+  bk->n = 0;
+}
+
+/**
+ * @brief Adds a pair to the batch of its shape, multiplying the batch once it is full
+ *
+ * @param b Batches of the calling consumer
+ * @param m1 Left operand, BatchFits(m1, m2) must hold
+ * @param m2 Right operand
+ * @param taken Passed on to done with the pair
+ * @param done Called with every pair of the batch and its product
+ * @param arg Passed on to done
+ */
+void BatchAdd(Batch *b, Matrix *m1, Matrix *m2, long long taken, BatchDone done, void *arg)
+{
+  int r = m1->rows, k = m1->cols, c = m2->cols;
+  int shape = ((r - 1) * BATCH_MAX_DIM + (k - 1)) * BATCH_MAX_DIM + (c - 1);
+  Bucket *bk = &b->buckets[shape];
+  int size = b->size;
+  if (bk->a == NULL) {
+    // First pair of this shape: allocate its bucket
+    bk->a = (int *)malloc(sizeof(int) * r * k * size);
+    bk->b = (int *)malloc(sizeof(int) * k * c * size);
+    bk->out = (int *)malloc(sizeof(int) * r * c * size);
+    bk->m1 = (Matrix **)malloc(sizeof(Matrix *) * size);
+    bk->m2 = (Matrix **)malloc(sizeof(Matrix *) * size);
+    bk->taken = (long long *)malloc(sizeof(long long) * size);
+    assert(bk->a != NULL && bk->b != NULL && bk->out != NULL);
+    assert(bk->m1 != NULL && bk->m2 != NULL && bk->taken != NULL);
+  }
+
+  // The clock is read only when a batch starts, not for every pair
+  long long now = 0;
+  if (bk->n == 0) {
+    now = LatencyNow();
+    bk->since = now;
+    if (b->pending == 0)
+      b->oldest = now;
+  }
+
+  // Gather the operands into the pair's lane
+  b->pending++;
+  int p = bk->n++;
+  for (int i = 0; i < r; i++)
+    for (int j = 0; j < k; j++)
+      bk->a[(i * k + j) * size + p] = m1->m[i][j];
+  for (int i = 0; i < k; i++)
+    for (int j = 0; j < c; j++)
+      bk->b[(i * c + j) * size + p] = m2->m[i][j];
+  bk->m1[p] = m1;
+  bk->m2[p] = m2;
+  bk->taken[p] = taken;
+
+  if (bk->n == size)
+    run(b, shape, done, arg);
+  if (now != 0 && b->pending > 0 && now - b->oldest >= BATCH_MAX_WAIT_NS)
+    BatchExpire(b, done, arg);
+}
+
+/**
+ * @brief Number of pairs gathered and not multiplied yet
+ */
+int BatchPending(Batch *b)
+{
+  return b->pending;
+}
+
+/**
+ * @brief Multiplies the batches whose first pair waited BATCH_MAX_WAIT_NS or longer
+ *
+ * Cheap when nothing is pending or nothing is old enough, so consumers can
+ * call it between pairs.
+ */
+void BatchExpire(Batch *b, BatchDone done, void *arg)
+{
+  if (b->pending == 0)
+    return;
+  long long now = LatencyNow();
+  if (now - b->oldest < BATCH_MAX_WAIT_NS)
+    return;
+  b->oldest = now;
+  for (int shape = 0; shape < BATCH_SHAPES; shape++) {
+    Bucket *bk = &b->buckets[shape];
+    if (bk->n == 0)
+      continue;
+    if (now - bk->since >= BATCH_MAX_WAIT_NS)
+      run(b, shape, done, arg);
+    else if (bk->since < b->oldest)
+      b->oldest = bk->since;
+  }
+}
+
+/**
+ * @brief Multiplies every partly filled batch
+ */
+void BatchFlush(Batch *b, BatchDone done, void *arg)
+{
+  for (int shape = 0; shape < BATCH_SHAPES; shape++)
+    if (b->buckets[shape].n > 0)
+      run(b, shape, done, arg);
+}
+
+/**
+ * @brief Releases the batches; they must have been flushed
+ */
+void BatchDestroy(Batch *b)
+{
+  for (int shape = 0; shape < BATCH_SHAPES; shape++) {
+    Bucket *bk = &b->buckets[shape];
+    assert(bk->n == 0);
+    free(bk->a);
+    free(bk->b);
+    free(bk->out);
+    free(bk->m1);
+    free(bk->m2);
+    free(bk->taken);
+  }
+  free(b);
+}
@@ -0,0 +1,33 @@
+/*
+ *  batch header
+ *  Function prototypes, data, and constants for batched small-matrix multiply module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// BATCHED SMALL-MATRIX MULTIPLY (structure of arrays, one batch per shape)
+
+// Largest row, inner or column dimension of a batched pair
+#define BATCH_MAX_DIM 4
+
+// Largest number of pairs in one batch
+#define BATCH_MAX 1024
+
+// Longest a pair waits in a partly filled batch, in nanoseconds; older
+// batches are multiplied as they are (see BatchExpire())
+#define BATCH_MAX_WAIT_NS 1000000LL
+
+typedef struct batch Batch;
+
+// Receives each pair of a multiplied batch with its product
+typedef void (*BatchDone)(Matrix *m1, Matrix *m2, Matrix *product, long long taken, void *arg);
+
+// batch methods
+Batch * BatchCreate(int size);
+int BatchFits(Matrix *m1, Matrix *m2);
+void BatchAdd(Batch *b, Matrix *m1, Matrix *m2, long long taken, BatchDone done, void *arg);
+void BatchFlush(Batch *b, BatchDone done, void *arg);
+int BatchPending(Batch *b);
+void BatchExpire(Batch *b, BatchDone done, void *arg);
+void BatchDestroy(Batch *b);
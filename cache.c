@@ -0,0 +1,254 @@
+/*
+ *  Product cache routines
+ *  Content-addressed cache of matrix products
+ *
+ *  Entries are keyed by a hash of both operands' shapes and elements and
+ *  verified by comparing stored copies of the operands, so a hash
+ *  collision can never return a wrong product. The cache is split into
+ *  CACHE_SHARDS shards with their own lock, each holding a fixed number
+ *  of entries evicted with the CLOCK (second chance) policy.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+#include "matrix.h"
+#include "cache.h"
+#include "pcmatrix.h"
+
+/**
+ * @file cache.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief One cached product with copies of the operands that produced it.
+ */
+typedef struct cache_entry {
+  uint64_t hash;     /**< Hash of both operands */
+  Matrix *a;         /**< Copy of the left operand, NULL if the slot is unused */
+  Matrix *b;         /**< Copy of the right operand */
+  Matrix *product;   /**< a x b */
+  int referenced;    /**< CLOCK reference bit */
+  int next;          /**< Next slot in the same bucket, -1 at the end */
+} CacheEntry;
+
+/**
+ * @brief Independently locked part of the cache.
+ */
+typedef struct cache_shard {
+  pthread_mutex_t lock;
+  CacheEntry *slots;  /**< Fixed pool of entries */
+  int *buckets;       /**< Hash index into slots, -1 when empty */
+  int nslots;
+  int nbuckets;
+  int hand;           /**< CLOCK hand */
+  long hits;
+  long misses;
+} CacheShard;
+
+/** Shards of the cache, NULL when the cache is disabled */
+static CacheShard *shards = NULL;
+
+/**
+ * @brief Mixes one value into a running 64-bit hash
+ */
+static inline uint64_t mix(uint64_t h, uint64_t v)
+{
+  h = (h ^ v) * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 29);
+}
+
+/**
+ * @brief Hashes the shapes and elements of both operands
+ */
+static uint64_t hash_pair(Matrix *m1, Matrix *m2)
+{
+  uint64_t h = mix(0, ((uint64_t)m1->rows << 32) | (uint32_t)m1->cols);
+  h = mix(h, ((uint64_t)m2->rows << 32) | (uint32_t)m2->cols);
+  for (int i = 0; i < m1->rows; i++)
+    for (int j = 0; j < m1->cols; j++)
+      h = mix(h, (uint32_t)m1->m[i][j]);
+  for (int i = 0; i < m2->rows; i++)
+    for (int j = 0; j < m2->cols; j++)
+      h = mix(h, (uint32_t)m2->m[i][j]);
+  return h;
+}
+
+/**
+ * @brief Creates an empty cache holding at most capacity products
+ *
+ * @param capacity Total number of entries across all shards
+ */
+void CacheInit(int capacity)
+{
+  int per_shard = (capacity + CACHE_SHARDS - 1) / CACHE_SHARDS;
+  if (per_shard < 1)
+    per_shard = 1;
+  shards = (CacheShard *)calloc(CACHE_SHARDS, sizeof(CacheShard));
+  assert(shards != NULL);
+  for (int s = 0; s < CACHE_SHARDS; s++) {
+    CacheShard *sh = &shards[s];
+    pthread_mutex_init(&sh->lock, NULL);
+    sh->nslots = per_shard;
+    sh->nbuckets = 2 * per_shard;
+    sh->slots = (CacheEntry *)calloc(sh->nslots, sizeof(CacheEntry));
+    sh->buckets = (int *)malloc(sizeof(int) * sh->nbuckets);
+    assert(sh->slots != NULL && sh->buckets != NULL);
+    for (int i = 0; i < sh->nbuckets; i++)
+      sh->buckets[i] = -1;
+  }
+}
+
+/**
+ * @brief Finds the slot caching m1 x m2 in a locked shard
+ *
+ * @return Slot index, or -1 on a miss
+ */
+static int lookup(CacheShard *sh, uint64_t hash, Matrix *m1, Matrix *m2)
+{
+  int i = sh->buckets[hash % sh->nbuckets];
+  while (i >= 0) {
+    CacheEntry *e = &sh->slots[i];
+    if (e->hash == hash && MatrixEqual(e->a, m1) && MatrixEqual(e->b, m2))
+      return i;
+    i = e->next;
+  }
+  return -1;
+}
+
+/**
+ * @brief Unlinks a slot from its bucket and frees its matrices
+ */
+static void evict(CacheShard *sh, int slot)
+{
+  CacheEntry *e = &sh->slots[slot];
+  int *link = &sh->buckets[e->hash % sh->nbuckets];
+  while (*link != slot)
+    link = &sh->slots[*link].next;
+  *link = e->next;
+  FreeMatrix(e->a);
+  FreeMatrix(e->b);
+  FreeMatrix(e->product);
+  e->a = e->b = e->product = NULL;
+}
+
+/**
+ * @brief Stores copies of the operands and product in a locked shard
+ */
+static void insert(CacheShard *sh, uint64_t hash, Matrix *m1, Matrix *m2, Matrix *product)
+{
+  // CLOCK: skip (and clear) recently referenced entries, take the first cold one
+  while (sh->slots[sh->hand].a != NULL && sh->slots[sh->hand].referenced) {
+    sh->slots[sh->hand].referenced = 0;
+    sh->hand = (sh->hand + 1) % sh->nslots;
+  }
+  int slot = sh->hand;
+  sh->hand = (sh->hand + 1) % sh->nslots;
+  if (sh->slots[slot].a != NULL)
+    evict(sh, slot);
+
+  CacheEntry *e = &sh->slots[slot];
+  e->hash = hash;
+  e->a = CopyMatrix(m1);
+  e->b = CopyMatrix(m2);
+  e->product = CopyMatrix(product);
+  e->referenced = 0;
+  int *bucket = &sh->buckets[hash % sh->nbuckets];
+  e->next = *bucket;
+  *bucket = slot;
+}
+
+/**
+ * @brief Multiplies m1 by m2, reusing a cached product when one exists
+ *
+ * Behaves like MatrixMultiply(): returns NULL for incompatible operands and
+ * otherwise a new matrix owned by the caller.
+ *
+ * @param m1 Left operand
+ * @param m2 Right operand
+ * @return Product of m1 and m2, or NULL if they cannot be multiplied
+ */
+Matrix *CacheMultiply(Matrix *m1, Matrix *m2)
+{
+  if (m1->cols != m2->rows)
+    return NULL;
+  if (m1->csr != NULL || m2->csr != NULL)
+    return MatrixMultiply(m1, m2);  // sparse operands are not cached
+
+  uint64_t hash = hash_pair(m1, m2);
+  CacheShard *sh = &shards[(hash >> 56) % CACHE_SHARDS];
+
+  pthread_mutex_lock(&sh->lock);
+  int slot = lookup(sh, hash, m1, m2);
+  if (slot >= 0) {
+    sh->hits++;
+    sh->slots[slot].referenced = 1;
+    Matrix *product = CopyMatrix(sh->slots[slot].product);
+    pthread_mutex_unlock(&sh->lock);
+    if (SHOW_RESULTS)
+      printf("MULTIPLY (%d x %d) BY (%d x %d):\n",m1->rows,m1->cols,m2->rows,m2->cols);
+    return product;
+  }
+  sh->misses++;
+  pthread_mutex_unlock(&sh->lock);
+
+  // Compute outside the shard lock so other lookups are not held up
+  Matrix *product = MatrixMultiply(m1, m2);
+
+  pthread_mutex_lock(&sh->lock);
+  if (lookup(sh, hash, m1, m2) < 0)  // another thread may have inserted it meanwhile
+    insert(sh, hash, m1, m2, product);
+  pthread_mutex_unlock(&sh->lock);
+  return product;
+}
+
+/**
+ * @brief Prints hit and miss counts and rates
+ *
+ * @param stream Output stream
+ */
+void CacheReport(FILE *stream)
+{
+  long hits = 0, misses = 0;
+  for (int s = 0; s < CACHE_SHARDS; s++) {
+    pthread_mutex_lock(&shards[s].lock);
+    hits += shards[s].hits;
+    misses += shards[s].misses;
+    pthread_mutex_unlock(&shards[s].lock);
+  }
+  long total = hits + misses;
+  fprintf(stream, "Product cache --> hits=%ld (%.1f%%) misses=%ld (%.1f%%)\n",
+          hits, total ? 100.0 * hits / total : 0.0,
+          misses, total ? 100.0 * misses / total : 0.0);
+}
+
+/**
+ * @brief Frees every cached matrix and the cache itself
+ */
+void CacheDestroy()
+{
+  for (int s = 0; s < CACHE_SHARDS; s++) {
+    CacheShard *sh = &shards[s];
+    for (int i = 0; i < sh->nslots; i++) {
+      if (sh->slots[i].a != NULL) {
+        FreeMatrix(sh->slots[i].a);
+        FreeMatrix(sh->slots[i].b);
+        FreeMatrix(sh->slots[i].product);
+      }
+    }
+    free(sh->slots);
+    free(sh->buckets);
+    pthread_mutex_destroy(&sh->lock);
+  }
+  free(shards);
+  shards = NULL;
+}
@@ -0,0 +1,18 @@
+/*
+ *  cache header
+ *  Function prototypes, data, and constants for product cache module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// PRODUCT CACHE (content addressed, sharded, bounded, CLOCK eviction)
+
+// Number of independently locked shards
+#define CACHE_SHARDS 16
+
+// cache methods
+void CacheInit(int capacity);
+Matrix * CacheMultiply(Matrix * m1, Matrix * m2);
+void CacheReport(FILE *stream);
+void CacheDestroy();
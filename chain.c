@@ -0,0 +1,136 @@
+/*
+ *  Matrix chain routines
+ *  Multiplies a run of compatible matrices A1 (p0 x p1), A2 (p1 x p2), ...
+ *  in the order chosen by the classic dynamic-programming
+ *  matrix-chain algorithm (Cormen et al., ch. 15.2)
+ *
+ *  Intermediate products live in a scratch arena and are released
+ *  together once the chain's product has been computed.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "arena.h"
+#include "matrix.h"
+#include "chain.h"
+
+/**
+ * @file chain.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Computes the cheapest parenthesization of a chain
+ *
+ * Fills plan with the split table and the scalar multiplication counts of
+ * both the optimal and the left-to-right orders. Tables are allocated from
+ * scratch, so the plan is valid until the arena is reset.
+ *
+ * @param chain Compatible matrices (chain[i]->cols == chain[i+1]->rows)
+ * @param n Number of matrices in the chain (>= 1)
+ * @param scratch Arena for the DP tables
+ * @param plan Output plan
+ */
+void MatrixChainOrder(Matrix **chain, int n, Arena *scratch, ChainPlan *plan)
+{
+  long long *cost = (long long *)ArenaAlloc(scratch, sizeof(long long) * n * n);
+  int *split = (int *)ArenaAlloc(scratch, sizeof(int) * n * n);
+  int *p = (int *)ArenaAlloc(scratch, sizeof(int) * (n + 1));
+
+  p[0] = chain[0]->rows;
+  for (int i = 0; i < n; i++) {
+    p[i + 1] = chain[i]->cols;
+    cost[i * n + i] = 0;
+  }
+
+  // cost[i][j] = min over k of cost[i][k] + cost[k+1][j] + p[i] * p[k+1] * p[j+1]
+  for (int len = 2; len <= n; len++) {
+    for (int i = 0; i + len - 1 < n; i++) {
+      int j = i + len - 1;
+      cost[i * n + j] = LLONG_MAX;
+      for (int k = i; k < j; k++) {
+        long long q = cost[i * n + k] + cost[(k + 1) * n + j]
+                      + (long long)p[i] * p[k + 1] * p[j + 1];
+        if (q < cost[i * n + j]) {
+          cost[i * n + j] = q;
+          split[i * n + j] = k;
+        }
+      }
+    }
+  }
+
+  plan->n = n;
+  plan->split = split;
+  plan->cost = cost[n - 1];
+  plan->naive = 0;
+  for (int i = 1; i < n; i++) {
+    plan->naive += (long long)p[0] * p[i] * p[i + 1];
+  }
+}
+
+/**
+ * @brief Multiplies chain[i..j] following the plan
+ *
+ * @param root Nonzero for the outermost product, which is heap allocated
+ *             so it outlives the scratch arena
+ */
+static Matrix *multiply_range(Matrix **chain, ChainPlan *plan, Arena *scratch, int i, int j, int root)
+{
+  if (i == j)
+    return chain[i];
+  int k = plan->split[i * plan->n + j];
+  Matrix *left = multiply_range(chain, plan, scratch, i, k, 0);
+  Matrix *right = multiply_range(chain, plan, scratch, k + 1, j, 0);
+  Matrix *out = root ? AllocMatrix(left->rows, right->cols)
+                     : ArenaAllocMatrix(scratch, left->rows, right->cols);
+  MatrixMultiplyInto(left, right, out);
+  return out;
+}
+
+/**
+ * @brief Multiplies a whole chain in the order computed by MatrixChainOrder()
+ *
+ * @param chain Compatible matrices, at least two
+ * @param plan Plan for this chain
+ * @param scratch Arena for intermediate products
+ * @return Heap allocated product, released with FreeMatrix()
+ */
+Matrix *MatrixChainMultiply(Matrix **chain, ChainPlan *plan, Arena *scratch)
+{
+  return multiply_range(chain, plan, scratch, 0, plan->n - 1, 1);
+}
+
+/**
+ * @brief Prints the parenthesization of chain[i..j], e.g. ((A1 A2) A3)
+ */
+static void display_range(ChainPlan *plan, int i, int j, FILE *stream)
+{
+  if (i == j) {
+    fprintf(stream, "A%d", i + 1);
+    return;
+  }
+  int k = plan->split[i * plan->n + j];
+  fprintf(stream, "(");
+  display_range(plan, i, k, stream);
+  fprintf(stream, " ");
+  display_range(plan, k + 1, j, stream);
+  fprintf(stream, ")");
+}
+
+/**
+ * @brief Prints the multiplication order chosen by the plan
+ *
+ * @param plan Plan to display
+ * @param stream Output stream
+ */
+void DisplayChainOrder(ChainPlan *plan, FILE *stream)
+{
+  display_range(plan, 0, plan->n - 1, stream);
+}
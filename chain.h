@@ -0,0 +1,28 @@
+/*
+ *  chain header
+ *  Function prototypes, data, and constants for matrix-chain module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// MATRIX CHAIN MULTIPLICATION
+
+// Longest chain a consumer will gather before multiplying
+#define MAX_CHAIN 64
+
+// Multiplication plan for a chain of n matrices A1..An where Ai is dims[i-1] x dims[i]
+// split[i*n+j] - index k where the product Ai..Aj is split into (Ai..Ak)(Ak+1..Aj)
+// cost         - scalar multiplications of the optimal order
+// naive        - scalar multiplications of the left-to-right order
+typedef struct chainplan {
+  int n;
+  int * split;
+  long long cost;
+  long long naive;
+} ChainPlan;
+
+// chain methods
+void MatrixChainOrder(Matrix ** chain, int n, struct arena *scratch, ChainPlan *plan);
+Matrix * MatrixChainMultiply(Matrix ** chain, ChainPlan *plan, struct arena *scratch);
+void DisplayChainOrder(ChainPlan *plan, FILE *stream);
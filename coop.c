@@ -0,0 +1,295 @@
+/*
+ *  coop module
+ *  Cooperative task runtime
+ *
+ *  Runs many logical producers and consumers as user-level tasks on a
+ *  small, fixed pool of kernel threads (one per core by default).
+ *  A task that would block on a condition is parked on a wait queue and
+ *  its kernel thread moves on to the next runnable task instead of
+ *  sleeping in pthread_cond_wait().
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "coop.h"
+
+/**
+ * @file coop.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/** Task lifecycle states */
+enum { COOP_READY, COOP_PARKED, COOP_YIELDED, COOP_FINISHED };
+
+/**
+ * @brief A user-level task with its own stack and saved context.
+ */
+struct coop_task {
+  ucontext_t ctx;                 /**< Saved registers and stack of the task */
+  void *(*fn)(void *);            /**< Task body */
+  void *arg;                      /**< Argument passed to fn */
+  void *result;                   /**< Value returned by fn */
+  void *stack;                    /**< mmap'ed stack, released when the task finishes */
+  pthread_mutex_t *unlock_after;  /**< Mutex the scheduler releases once the task is switched out */
+  int state;                      /**< One of the COOP_* states */
+  coop_task_t *next;              /**< Link for the run queue or a condition queue */
+};
+
+/** Global run queue shared by all scheduler threads */
+static pthread_mutex_t rq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rq_ready = PTHREAD_COND_INITIALIZER;
+static coop_task_t *rq_head = NULL;
+static coop_task_t *rq_tail = NULL;
+/** Number of spawned tasks that have not finished yet */
+static int live = 0;
+
+/** Scheduler context and running task of the calling kernel thread */
+static __thread ucontext_t sched_ctx;
+static __thread coop_task_t *current = NULL;
+
+COOP_TLS_ACCESSOR coop_task_t *self()
+{
+  return current;
+}
+
+COOP_TLS_ACCESSOR ucontext_t *scheduler()
+{
+  return &sched_ctx;
+}
+
+/**
+ * @brief Appends a task to the run queue and wakes an idle scheduler thread.
+ */
+static void enqueue(coop_task_t *t)
+{
+  t->next = NULL;
+  pthread_mutex_lock(&rq_lock);
+  if (rq_tail == NULL)
+    rq_head = t;
+  else
+    rq_tail->next = t;
+  rq_tail = t;
+  pthread_cond_signal(&rq_ready);
+  pthread_mutex_unlock(&rq_lock);
+}
+
+/**
+ * @brief Entry point of every task; runs the body then returns to the scheduler.
+ */
+static void trampoline()
+{
+  coop_task_t *t = self();
+  t->result = t->fn(t->arg);
+  t = self();
+  t->state = COOP_FINISHED;
+  swapcontext(&t->ctx, scheduler());
+}
+
+/**
+ * @brief Scheduler loop run by each kernel thread of the pool.
+ *
+ * Pops runnable tasks and switches into them until every task has finished.
+ * When a task parks on a condition, its mutex is released here, after the
+ * task's context has been saved, so a signaller can never resume a task
+ * that is still running on another thread.
+ */
+static void *sched_worker(void *arg)
+{
+  while (1) {
+    pthread_mutex_lock(&rq_lock);
+    while (rq_head == NULL && live > 0) {
+      pthread_cond_wait(&rq_ready, &rq_lock);
+    }
+    if (rq_head == NULL) {  // nothing left to run
+      pthread_mutex_unlock(&rq_lock);
+      break;
+    }
+    coop_task_t *t = rq_head;
+    rq_head = t->next;
+    if (rq_head == NULL)
+      rq_tail = NULL;
+    pthread_mutex_unlock(&rq_lock);
+
+    current = t;
+    swapcontext(&sched_ctx, &t->ctx);
+    current = NULL;
+
+    if (t->state == COOP_FINISHED) {
+      munmap(t->stack, COOP_STACK_SIZE);
+      t->stack = NULL;
+      pthread_mutex_lock(&rq_lock);
+      live--;
+      if (live == 0)
+        pthread_cond_broadcast(&rq_ready);  // let the other scheduler threads exit
+      pthread_mutex_unlock(&rq_lock);
+    }
+    else if (t->state == COOP_PARKED) {
+      pthread_mutex_t *m = t->unlock_after;
+      t->unlock_after = NULL;
+      pthread_mutex_unlock(m);  // t may be resumed elsewhere from here on
+    }
+    else {
+      enqueue(t);  // plain yield
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Creates a task that will run fn(arg) once coop_run() is called.
+ *
+ * @param fn Task body
+ * @param arg Argument passed to fn
+ * @return Handle used to collect the result with coop_join()
+ */
+coop_task_t *coop_spawn(void *(*fn)(void *), void *arg)
+{
+  coop_task_t *t = (coop_task_t *)malloc(sizeof(coop_task_t));
+  assert(t != NULL);
+  t->stack = mmap(NULL, COOP_STACK_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+  assert(t->stack != MAP_FAILED);
+  getcontext(&t->ctx);
+  t->ctx.uc_stack.ss_sp = t->stack;
+  t->ctx.uc_stack.ss_size = COOP_STACK_SIZE;
+  t->ctx.uc_link = NULL;
+  makecontext(&t->ctx, trampoline, 0);
+  t->fn = fn;
+  t->arg = arg;
+  t->result = NULL;
+  t->unlock_after = NULL;
+  t->state = COOP_READY;
+
+  pthread_mutex_lock(&rq_lock);
+  live++;
+  pthread_mutex_unlock(&rq_lock);
+  enqueue(t);
+  return t;
+}
+
+/**
+ * @brief Runs all spawned tasks to completion on nworkers kernel threads.
+ *
+ * @param nworkers Size of the scheduler thread pool
+ */
+void coop_run(int nworkers)
+{
+  if (nworkers < 1)
+    nworkers = 1;
+  pthread_t pool[nworkers];
+  for (int i = 0; i < nworkers; i++) {
+    if (pthread_create(&pool[i], NULL, sched_worker, NULL) != 0) {
+      perror("Scheduler Thread");
+    }
+  }
+  for (int i = 0; i < nworkers; i++) {
+    pthread_join(pool[i], NULL);
+  }
+}
+
+/**
+ * @brief Returns the result of a finished task and releases it.
+ *
+ * @param t Task returned by coop_spawn()
+ * @return Value returned by the task body
+ */
+void *coop_join(coop_task_t *t)
+{
+  assert(t->state == COOP_FINISHED);
+  void *result = t->result;
+  free(t);
+  return result;
+}
+
+/**
+ * @brief Puts the calling task at the back of the run queue.
+ */
+void coop_yield()
+{
+  coop_task_t *t = self();
+  t->state = COOP_YIELDED;
+  swapcontext(&t->ctx, scheduler());
+}
+
+/**
+ * @brief Number of scheduler threads to use: one per online core.
+ */
+int coop_default_workers()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+/**
+ * @brief Parks the calling task on c and releases m, like pthread_cond_wait().
+ *
+ * The kernel thread goes on running other tasks. The mutex is re-acquired
+ * before returning.
+ *
+ * @param c Condition to wait on
+ * @param m Mutex held by the caller
+ */
+void coop_cond_wait(coop_cond_t *c, pthread_mutex_t *m)
+{
+  coop_task_t *t = self();
+  t->next = NULL;
+  if (c->tail == NULL)
+    c->head = t;
+  else
+    c->tail->next = t;
+  c->tail = t;
+  t->unlock_after = m;
+  t->state = COOP_PARKED;
+  swapcontext(&t->ctx, scheduler());
+  pthread_mutex_lock(m);
+}
+
+/**
+ * @brief Makes the oldest task parked on c runnable again.
+ */
+void coop_cond_signal(coop_cond_t *c)
+{
+  coop_task_t *t = c->head;
+  if (t == NULL)
+    return;
+  c->head = t->next;
+  if (c->head == NULL)
+    c->tail = NULL;
+  t->state = COOP_READY;
+  enqueue(t);
+}
+
+/**
+ * @brief Makes every task parked on c runnable again.
+ */
+void coop_cond_broadcast(coop_cond_t *c)
+{
+  while (c->head != NULL) {
+    coop_cond_signal(c);
+  }
+}
+
+/**
+ * @brief Allocates scratch space whose size depends on the input.
+ *
+ * Code that may run as a task takes such scratch from here rather than
+ * from a variable length array: a task's stack is only COOP_STACK_SIZE
+ * bytes, and one wide matrix row can overflow it. Release with free().
+ */
+void * coop_scratch(size_t bytes)
+{
+  void *p = malloc(bytes);
+  assert(p != NULL);
+  return p;
+}
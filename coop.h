@@ -0,0 +1,45 @@
+/*
+ *  coop header
+ *  Function prototypes, data, and constants for cooperative task module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// COOPERATIVE TASKS (M:N scheduling of producers and consumers)
+
+// Stack size given to every task
+#define COOP_STACK_SIZE (64 * 1024)
+
+// Storage class of an accessor of thread-local state.
+// A task can resume on another kernel thread after any wait, so such
+// accessors are kept out of line: inlined, the compiler could reuse a
+// thread-local address computed on the thread the task ran on before.
+#define COOP_TLS_ACCESSOR static __attribute__((noinline))
+
+typedef struct coop_task coop_task_t;
+
+// Queue of tasks parked on a condition.
+// Protected by the mutex passed to coop_cond_wait(), which must also be
+// held by anyone calling coop_cond_signal() or coop_cond_broadcast().
+typedef struct coop_cond {
+  coop_task_t * head;
+  coop_task_t * tail;
+} coop_cond_t;
+
+#define COOP_COND_INITIALIZER { NULL, NULL }
+
+// task methods
+coop_task_t * coop_spawn(void *(*fn)(void *), void *arg);
+void coop_run(int nworkers);
+void * coop_join(coop_task_t *t);
+void coop_yield();
+int coop_default_workers();
+
+// condition methods
+void coop_cond_wait(coop_cond_t *c, pthread_mutex_t *m);
+void coop_cond_signal(coop_cond_t *c);
+void coop_cond_broadcast(coop_cond_t *c);
+
+// scratch methods
+void * coop_scratch(size_t bytes);
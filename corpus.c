@@ -0,0 +1,205 @@
+/*
+ *  Matrix corpus routines
+ *  Reads and writes indexed binary collections of matrices
+ *
+ *  A corpus has a fixed header, an index of shapes and payload offsets,
+ *  and aligned contiguous payloads. Opening a corpus maps the file and
+ *  checks only the header, so it is instant regardless of size, and any
+ *  matrix can be fetched by number as a zero-copy view of the mapping.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "corpus.h"
+
+/**
+ * @file corpus.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Maps a corpus and validates its header
+ *
+ * @param path Corpus file
+ * @return Open corpus, or NULL (with a message on stderr) if it is not valid
+ */
+Corpus *CorpusOpen(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CorpusHeader)) {
+    fprintf(stderr, "%s: not a matrix corpus\n", path);
+    close(fd);
+    return NULL;
+  }
+  const char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    return NULL;
+  }
+
+  const CorpusHeader *h = (const CorpusHeader *)base;
+  if (memcmp(h->magic, CORPUS_MAGIC, sizeof(h->magic)) != 0
+      || h->version != CORPUS_VERSION
+      || h->byte_order != CORPUS_BYTE_ORDER
+      || h->elem_size != sizeof(int)
+      || h->index_offset % sizeof(uint64_t) != 0
+      || h->index_offset > (uint64_t)st.st_size
+      || h->count > ((uint64_t)st.st_size - h->index_offset) / sizeof(CorpusEntry)
+      || h->data_offset > (uint64_t)st.st_size) {
+    fprintf(stderr, "%s: not a matrix corpus (or written on another platform)\n", path);
+    munmap((void *)base, st.st_size);
+    return NULL;
+  }
+
+  Corpus *c = (Corpus *)malloc(sizeof(Corpus));
+  assert(c != NULL);
+  c->base = base;
+  c->length = st.st_size;
+  c->header = h;
+  c->index = (const CorpusEntry *)(base + h->index_offset);
+  c->count = h->count;
+  return c;
+}
+
+/**
+ * @brief Number of matrices in the corpus
+ */
+long CorpusCount(Corpus *c)
+{
+  return c->count;
+}
+
+/**
+ * @brief Returns matrix i as a view of the mapped payload (MATRIX_VIEW)
+ *
+ * @param c Open corpus
+ * @param i Matrix number, 0 <= i < CorpusCount(c)
+ * @return View valid until CorpusClose(), or NULL if the entry is corrupt
+ */
+Matrix *CorpusMatrix(Corpus *c, long i)
+{
+  const CorpusEntry *e = &c->index[i];
+  uint64_t bytes = (uint64_t)e->rows * e->cols * sizeof(int);
+  if (e->rows == 0 || e->cols == 0 || e->offset % sizeof(int) != 0
+      || e->offset > c->length || bytes > c->length - e->offset) {
+    fprintf(stderr, "corpus: corrupt entry %ld\n", i);
+    return NULL;
+  }
+  return AllocMatrixView(e->rows, e->cols, (int *)(c->base + e->offset));
+}
+
+/**
+ * @brief Unmaps the corpus; views returned by CorpusMatrix() become invalid
+ */
+void CorpusClose(Corpus *c)
+{
+  munmap((void *)c->base, c->length);
+  free(c);
+}
+
+/**
+ * @brief Starts writing a corpus that will hold exactly count matrices
+ *
+ * @param path File to create
+ * @param count Number of matrices that will be appended
+ * @return Writer, or NULL if the file cannot be created
+ */
+CorpusWriter *CorpusCreate(const char *path, long count)
+{
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    perror(path);
+    return NULL;
+  }
+  CorpusWriter *w = (CorpusWriter *)malloc(sizeof(CorpusWriter));
+  assert(w != NULL);
+  w->file = f;
+  w->count = count;
+  w->written = 0;
+  w->index = (CorpusEntry *)calloc(count > 0 ? count : 1, sizeof(CorpusEntry));
+  assert(w->index != NULL);
+
+  // Payloads start after the header and index, on an aligned boundary
+  uint64_t data = sizeof(CorpusHeader) + count * sizeof(CorpusEntry);
+  w->offset = (data + CORPUS_ALIGN - 1) / CORPUS_ALIGN * CORPUS_ALIGN;
+  fseeko(f, w->offset, SEEK_SET);
+  return w;
+}
+
+/**
+ * @brief Appends one matrix's payload and records it in the index
+ *
+ * @return 0 on success, -1 if the corpus is full or the write failed
+ */
+int CorpusAppend(CorpusWriter *w, Matrix *mat)
+{
+  if (w->written >= w->count)
+    return -1;
+  CorpusEntry *e = &w->index[w->written++];
+  e->rows = mat->rows;
+  e->cols = mat->cols;
+  e->offset = w->offset;
+  for (int i = 0; i < mat->rows; i++) {
+    if (fwrite(mat->m[i], sizeof(int), mat->cols, w->file) != (size_t)mat->cols)
+      return -1;
+  }
+  uint64_t bytes = (uint64_t)mat->rows * mat->cols * sizeof(int);
+  uint64_t padded = (bytes + CORPUS_ALIGN - 1) / CORPUS_ALIGN * CORPUS_ALIGN;
+  static const char zeros[CORPUS_ALIGN];
+  if (padded > bytes && fwrite(zeros, 1, padded - bytes, w->file) != padded - bytes)
+    return -1;
+  w->offset += padded;
+  return 0;
+}
+
+/**
+ * @brief Writes the header and index, then closes the corpus
+ *
+ * @return 0 on success, -1 if fewer matrices than announced were appended
+ *         or the file could not be written
+ */
+int CorpusFinish(CorpusWriter *w)
+{
+  int rc = w->written == w->count ? 0 : -1;
+  CorpusHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, CORPUS_MAGIC, sizeof(h.magic));
+  h.version = CORPUS_VERSION;
+  h.byte_order = CORPUS_BYTE_ORDER;
+  h.count = w->written;
+  h.index_offset = sizeof(CorpusHeader);
+  h.data_offset = (sizeof(CorpusHeader) + w->count * sizeof(CorpusEntry) + CORPUS_ALIGN - 1)
+                  / CORPUS_ALIGN * CORPUS_ALIGN;
+  h.align = CORPUS_ALIGN;
+  h.elem_size = sizeof(int);
+
+  fseeko(w->file, 0, SEEK_SET);
+  if (fwrite(&h, sizeof(h), 1, w->file) != 1
+      || fwrite(w->index, sizeof(CorpusEntry), w->written, w->file) != (size_t)w->written)
+    rc = -1;
+  if (fclose(w->file) != 0)
+    rc = -1;
+  free(w->index);
+  free(w);
+  return rc;
+}
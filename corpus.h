@@ -0,0 +1,65 @@
+/*
+ *  corpus header
+ *  Function prototypes, data, and constants for matrix corpus module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// MATRIX CORPUS (indexed, memory-mapped collection of matrices)
+//
+// File layout, all integers in host byte order:
+//   CorpusHeader   at offset 0
+//   CorpusEntry    count entries at index_offset
+//   payloads       rows*cols int32 elements each, row-major, every payload
+//                  starting on a CORPUS_ALIGN byte boundary
+
+#define CORPUS_MAGIC "PCMCORP1"
+#define CORPUS_VERSION 1
+#define CORPUS_BYTE_ORDER 0x01020304
+#define CORPUS_ALIGN 64
+
+typedef struct corpus_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t count;
+  uint64_t index_offset;
+  uint64_t data_offset;
+  uint32_t align;
+  uint32_t elem_size;
+  uint64_t reserved[2];
+} CorpusHeader;
+
+typedef struct corpus_entry {
+  uint32_t rows;
+  uint32_t cols;
+  uint64_t offset;
+} CorpusEntry;
+
+typedef struct corpus {
+  const char * base;
+  size_t length;
+  const CorpusHeader * header;
+  const CorpusEntry * index;
+  long count;
+} Corpus;
+
+// Writer for a corpus of a known number of matrices
+typedef struct corpus_writer {
+  FILE * file;
+  CorpusEntry * index;
+  long count;
+  long written;
+  uint64_t offset;
+} CorpusWriter;
+
+// corpus methods
+Corpus * CorpusOpen(const char *path);
+long CorpusCount(Corpus *c);
+Matrix * CorpusMatrix(Corpus *c, long i);
+void CorpusClose(Corpus *c);
+
+CorpusWriter * CorpusCreate(const char *path, long count);
+int CorpusAppend(CorpusWriter *w, Matrix *mat);
+int CorpusFinish(CorpusWriter *w);
@@ -0,0 +1,335 @@
+/*
+ *  Matrix input routines
+ *  Feeds producers with matrices read from a file or stdin
+ *
+ *  The input is memory mapped (stdin is read into memory when it is a
+ *  pipe) and split into one byte range per producer, each range starting
+ *  on a matrix boundary, so producers parse in parallel without sharing
+ *  a file offset. Binary records are not copied: the matrices handed out
+ *  are views of the mapping, which stays mapped until CloseInput().
+ *  A corpus is split by matrix number instead, using its index.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "corpus.h"
+#include "input.h"
+
+/**
+ * @file input.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/** Whole input, either mapped or read into a heap buffer */
+static const char *base = NULL;
+static size_t length = 0;
+static int mapped = 0;
+static int input_format = INPUT_TEXT;
+static Corpus *corpus = NULL;
+
+/** One cursor per producer and the index of the next unclaimed one */
+static InputCursor *parts = NULL;
+static int nparts_total = 0;
+static int next_part = 0;
+
+/**
+ * @brief Reads all of a non-mappable descriptor (e.g. a pipe) into memory
+ */
+static char *slurp(int fd, size_t *len)
+{
+  size_t cap = 1 << 20, n = 0;
+  char *buf = (char *)malloc(cap);
+  assert(buf != NULL);
+  while (1) {
+    if (n == cap) {
+      cap *= 2;
+      buf = (char *)realloc(buf, cap);
+      assert(buf != NULL);
+    }
+    ssize_t r = read(fd, buf + n, cap - n);
+    if (r <= 0)
+      break;
+    n += r;
+  }
+  *len = n;
+  return buf;
+}
+
+/**
+ * @brief Returns nonzero if the line starting at p is a DisplayMatrix row
+ */
+static inline int is_row(const char *p, const char *end)
+{
+  return p < end && *p == '|';
+}
+
+/**
+ * @brief Returns the start of the line following the one containing p
+ */
+static inline const char *next_line(const char *p, const char *end)
+{
+  const char *nl = memchr(p, '\n', end - p);
+  return nl ? nl + 1 : end;
+}
+
+/**
+ * @brief Finds the first text matrix starting at or after off
+ *
+ * A matrix starts on a row line whose previous line is not a row line.
+ */
+static const char *text_boundary(const char *off, const char *end)
+{
+  const char *p = off;
+  if (p > base && p[-1] != '\n')
+    p = next_line(p, end);  // align to a line start
+  while (p < end) {
+    if (is_row(p, end)) {
+      const char *prev = p - 1;
+      if (p == base)
+        return p;
+      while (prev > base && prev[-1] != '\n')
+        prev--;
+      if (!is_row(prev, end))
+        return p;
+    }
+    p = next_line(p, end);
+  }
+  return end;
+}
+
+/**
+ * @brief Parses one "|  a   b   c|" row into out, returns the number of values
+ */
+static int parse_row(const char *p, const char *end, int *out, int max)
+{
+  int n = 0;
+  p++;  // skip the opening '|'
+  while (p < end && *p != '|' && *p != '\n') {
+    if (*p == ' ') {
+      p++;
+      continue;
+    }
+    int neg = 0, v = 0;
+    if (*p == '-') {
+      neg = 1;
+      p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+      v = v * 10 + (*p - '0');
+      p++;
+    }
+    if (out != NULL && n < max)
+      out[n] = neg ? -v : v;
+    n++;
+    while (p < end && *p != ' ' && *p != '|' && *p != '\n')
+      p++;  // skip anything unexpected
+  }
+  return n;
+}
+
+/**
+ * @brief Parses the next text matrix of a cursor
+ */
+static Matrix *next_text(InputCursor *cur)
+{
+  const char *p = cur->pos;
+  while (p < cur->end && !is_row(p, cur->end))
+    p = next_line(p, cur->end);
+  if (p >= cur->end) {
+    cur->pos = cur->end;
+    return NULL;
+  }
+
+  // The matrix may run past the end of this part; it still belongs to it
+  const char *end = base + length;
+  int rows = 0;
+  const char *q = p;
+  while (is_row(q, end)) {
+    rows++;
+    q = next_line(q, end);
+  }
+  // Every row must have the first row's values, and at least one
+  int cols = parse_row(p, end, NULL, 0);
+  if (cols < 1) {
+    fprintf(stderr, "input: empty text matrix row at offset %ld\n", (long)(p - base));
+    cur->pos = cur->end;
+    return NULL;
+  }
+  Matrix *mat = AllocMatrix(rows, cols);
+  q = p;
+  for (int i = 0; i < rows; i++) {
+    if (parse_row(q, end, mat->m[i], cols) != cols) {
+      fprintf(stderr, "input: ragged text matrix at offset %ld (row %d does not have %d values)\n",
+              (long)(p - base), i + 1, cols);
+      FreeMatrix(mat);
+      cur->pos = cur->end;
+      return NULL;
+    }
+    q = next_line(q, end);
+  }
+  cur->pos = q;
+  return mat;
+}
+
+/**
+ * @brief Returns the next binary matrix of a cursor as a view of the input
+ */
+static Matrix *next_binary(InputCursor *cur)
+{
+  const char *end = base + length;
+  if (cur->pos >= cur->end || end - cur->pos < 2 * (long)sizeof(int32_t))
+    return NULL;
+  const int32_t *hdr = (const int32_t *)cur->pos;
+  int rows = hdr[0], cols = hdr[1];
+  size_t bytes = 2 * sizeof(int32_t) + (size_t)rows * cols * sizeof(int32_t);
+  if (rows <= 0 || cols <= 0 || bytes > (size_t)(end - cur->pos)) {
+    fprintf(stderr, "input: corrupt binary record at offset %ld\n", (long)(cur->pos - base));
+    cur->pos = cur->end;
+    return NULL;
+  }
+  cur->pos += bytes;
+  return AllocMatrixView(rows, cols, (int *)(hdr + 2));
+}
+
+/**
+ * @brief Opens an input and splits it into nparts byte ranges
+ *
+ * @param path File to read, or "-" for stdin
+ * @param format INPUT_TEXT or INPUT_BINARY
+ * @param nparts Number of producers that will claim a part
+ * @return 0 on success, -1 on failure
+ */
+int OpenInput(const char *path, int format, int nparts)
+{
+  input_format = format;
+  nparts_total = nparts;
+  next_part = 0;
+  parts = (InputCursor *)malloc(sizeof(InputCursor) * nparts);
+  assert(parts != NULL);
+
+  if (format == INPUT_CORPUS) {
+    corpus = CorpusOpen(path);
+    if (corpus == NULL)
+      return -1;
+    long n = CorpusCount(corpus);
+    for (int i = 0; i < nparts; i++) {
+      parts[i].next = n * i / nparts;
+      parts[i].last = n * (i + 1) / nparts;
+    }
+    return 0;
+  }
+
+  int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    length = st.st_size;
+    base = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (base == MAP_FAILED) {
+      perror("mmap");
+      return -1;
+    }
+    madvise((void *)base, length, MADV_SEQUENTIAL);
+    mapped = 1;
+  }
+  else {
+    base = slurp(fd, &length);
+    mapped = 0;
+  }
+  if (fd != STDIN_FILENO)
+    close(fd);
+
+  // Part i covers [i*length/nparts, (i+1)*length/nparts), moved to matrix boundaries
+  const char *end = base + length;
+  const char *starts[nparts + 1];
+  if (format == INPUT_TEXT) {
+    for (int i = 0; i < nparts; i++)
+      starts[i] = text_boundary(base + length * i / nparts, end);
+  }
+  else {
+    // Binary records only delimit each other, so walk the headers once
+    const char *p = base;
+    int i = 0;
+    while (i < nparts) {
+      size_t target = length * i / nparts;
+      while (p < end && (size_t)(p - base) < target && end - p >= 2 * (long)sizeof(int32_t)) {
+        const int32_t *hdr = (const int32_t *)p;
+        if (hdr[0] <= 0 || hdr[1] <= 0)
+          break;
+        p += 2 * sizeof(int32_t) + (size_t)hdr[0] * hdr[1] * sizeof(int32_t);
+      }
+      starts[i++] = p < end ? p : end;
+    }
+  }
+  starts[nparts] = end;
+  for (int i = 0; i < nparts; i++) {
+    parts[i].pos = starts[i];
+    parts[i].end = starts[i + 1] > starts[i] ? starts[i + 1] : starts[i];
+  }
+  return 0;
+}
+
+/**
+ * @brief Hands the calling producer its own part of the input
+ *
+ * @return Cursor over the part, or NULL if every part has been claimed
+ */
+InputCursor *InputClaim()
+{
+  int i = __atomic_fetch_add(&next_part, 1, __ATOMIC_RELAXED);
+  return i < nparts_total ? &parts[i] : NULL;
+}
+
+/**
+ * @brief Returns the next matrix of a part
+ *
+ * Text matrices are parsed into heap storage; binary and corpus matrices
+ * are views of the input (MATRIX_VIEW) and must not outlive CloseInput().
+ *
+ * @param cur Cursor returned by InputClaim()
+ * @return Next matrix, or NULL when the part is exhausted
+ */
+Matrix *InputNext(InputCursor *cur)
+{
+  if (input_format == INPUT_CORPUS)
+    return cur->next < cur->last ? CorpusMatrix(corpus, cur->next++) : NULL;
+  if (input_format == INPUT_BINARY)
+    return next_binary(cur);
+  return next_text(cur);
+}
+
+/**
+ * @brief Unmaps or frees the input; no matrix view may be used afterwards
+ */
+void CloseInput()
+{
+  if (corpus != NULL) {
+    CorpusClose(corpus);
+    corpus = NULL;
+  }
+  else if (mapped)
+    munmap((void *)base, length);
+  else
+    free((void *)base);
+  free(parts);
+  base = NULL;
+  parts = NULL;
+  length = 0;
+}
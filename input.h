@@ -0,0 +1,34 @@
+/*
+ *  input header
+ *  Function prototypes, data, and constants for matrix input module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// MATRIX INPUT (replay matrices from a file or stdin instead of generating them)
+
+// INPUT_TEXT   - rows as printed by DisplayMatrix, e.g. "|  1   2|";
+//                consecutive row lines form one matrix, other lines separate them
+// INPUT_BINARY - records of int32 rows, int32 cols, then rows*cols int32
+//                elements in row-major order, native byte order
+// INPUT_CORPUS - indexed corpus written by pcCorpus (see corpus.h)
+#define INPUT_TEXT 0
+#define INPUT_BINARY 1
+#define INPUT_CORPUS 2
+
+// Part of the input owned by one producer
+// pos/end   - byte range for text and binary input
+// next/last - matrix numbers for corpus input
+typedef struct input_cursor {
+  const char * pos;
+  const char * end;
+  long next;
+  long last;
+} InputCursor;
+
+// input methods
+int OpenInput(const char *path, int format, int nparts);
+InputCursor * InputClaim();
+Matrix * InputNext(InputCursor *cur);
+void CloseInput();
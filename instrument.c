@@ -0,0 +1,208 @@
+/*
+ *  Hot-path instrumentation routines
+ *  Lock, condition variable and buffer counters for the bounded buffer
+ *
+ *  Every thread updates its own counters without synchronization; the
+ *  counters of all threads are linked into a registry when first used
+ *  and merged by InstrReport() at the end of the run. Built only when
+ *  INSTRUMENT is nonzero.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+#include "pcmatrix.h"
+#include "latency.h"
+#include "coop.h"
+#include "instrument.h"
+
+/**
+ * @file instrument.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+#if INSTRUMENT
+
+/**
+ * @brief Counters of one thread
+ */
+typedef struct instr_stats {
+  long acquires;          /**< buffer lock acquisitions */
+  long long lock_wait_ns; /**< time spent waiting for the buffer lock */
+  long long hold_ns;      /**< time the buffer lock was held */
+  long long held_since;   /**< start of the current hold, 0 when not holding */
+  long waits;             /**< condition waits */
+  long long wait_ns;      /**< time spent in condition waits, including re-locking */
+  long spurious;          /**< waits started again without progress since the last wake-up */
+  int woken;              /**< woke from a wait and made no progress yet */
+  long occupancy[INSTR_OCCUPANCY_BINS];
+  long discards[INSTR_DISCARD_BINS];
+  struct instr_stats *next;
+} InstrStats;
+
+/** Registry of every thread's counters */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static InstrStats *registry = NULL;
+
+static __thread InstrStats *mine = NULL;
+
+/**
+ * @brief Counters of the calling thread, registered on first use
+ */
+COOP_TLS_ACCESSOR InstrStats *stats()
+{
+  if (mine == NULL) {
+    mine = (InstrStats *)calloc(1, sizeof(InstrStats));
+    assert(mine != NULL);
+    pthread_mutex_lock(&registry_lock);
+    mine->next = registry;
+    registry = mine;
+    pthread_mutex_unlock(&registry_lock);
+  }
+  return mine;
+}
+
+/**
+ * @brief Locks m, recording the time spent waiting for it
+ */
+void instr_lock(pthread_mutex_t *m)
+{
+  long long start = LatencyNow();
+  pthread_mutex_lock(m);
+  long long end = LatencyNow();
+  InstrStats *s = stats();
+  s->acquires++;
+  s->lock_wait_ns += end - start;
+  s->held_since = end;
+}
+
+/**
+ * @brief Unlocks m, recording how long it was held
+ */
+void instr_unlock(pthread_mutex_t *m)
+{
+  InstrStats *s = stats();
+  if (s->held_since != 0)
+    s->hold_ns += LatencyNow() - s->held_since;
+  s->held_since = 0;
+  s->woken = 0;
+  pthread_mutex_unlock(m);
+}
+
+/**
+ * @brief Called before a condition wait; the lock stops being held
+ *
+ * @return Start time to pass to instr_wait_end()
+ */
+long long instr_wait_begin()
+{
+  InstrStats *s = stats();
+  long long start = LatencyNow();
+  if (s->held_since != 0)
+    s->hold_ns += start - s->held_since;
+  s->held_since = 0;
+  if (s->woken)
+    s->spurious++;  // woke up, found nothing to do, and is waiting again
+  s->waits++;
+  return start;
+}
+
+/**
+ * @brief Called once a condition wait returns with the lock held again
+ *
+ * @param start Value returned by instr_wait_begin()
+ */
+void instr_wait_end(long long start)
+{
+  InstrStats *s = stats();
+  long long end = LatencyNow();
+  s->wait_ns += end - start;
+  s->held_since = end;
+  s->woken = 1;
+}
+
+/**
+ * @brief Samples the buffer occupancy after a put() or get()
+ *
+ * @param count Matrices in the buffer
+ * @param size Capacity of the buffer
+ */
+void instr_occupancy(int count, int size)
+{
+  InstrStats *s = stats();
+  int bin = size > 0 ? (int)((long)count * (INSTR_OCCUPANCY_BINS - 1) / size) : 0;
+  if (bin >= INSTR_OCCUPANCY_BINS)
+    bin = INSTR_OCCUPANCY_BINS - 1;
+  s->occupancy[bin]++;
+  s->woken = 0;  // a put() or get() is progress
+}
+
+/**
+ * @brief Records how many incompatible matrices a consumer discarded
+ *        while looking for a partner
+ *
+ * @param n Number of discarded matrices
+ */
+void instr_discards(int n)
+{
+  if (n >= INSTR_DISCARD_BINS)
+    n = INSTR_DISCARD_BINS - 1;
+  stats()->discards[n]++;
+}
+
+/**
+ * @brief Prints the counters merged over every thread
+ *
+ * @param stream Output stream
+ */
+void InstrReport(FILE *stream)
+{
+  InstrStats t = { 0 };
+  pthread_mutex_lock(&registry_lock);
+  for (InstrStats *s = registry; s != NULL; s = s->next) {
+    t.acquires += s->acquires;
+    t.lock_wait_ns += s->lock_wait_ns;
+    t.hold_ns += s->hold_ns;
+    t.waits += s->waits;
+    t.wait_ns += s->wait_ns;
+    t.spurious += s->spurious;
+    for (int i = 0; i < INSTR_OCCUPANCY_BINS; i++)
+      t.occupancy[i] += s->occupancy[i];
+    for (int i = 0; i < INSTR_DISCARD_BINS; i++)
+      t.discards[i] += s->discards[i];
+  }
+  pthread_mutex_unlock(&registry_lock);
+
+  fprintf(stream, "Lock --> acquires=%ld wait total=%.3fms avg=%.0fns hold total=%.3fms avg=%.0fns\n",
+          t.acquires, t.lock_wait_ns / 1e6, t.acquires ? (double)t.lock_wait_ns / t.acquires : 0.0,
+          t.hold_ns / 1e6, t.acquires ? (double)t.hold_ns / t.acquires : 0.0);
+  fprintf(stream, "Condition waits --> waits=%ld total=%.3fms avg=%.0fns spurious=%ld\n",
+          t.waits, t.wait_ns / 1e6, t.waits ? (double)t.wait_ns / t.waits : 0.0, t.spurious);
+
+  long samples = 0;
+  for (int i = 0; i < INSTR_OCCUPANCY_BINS; i++)
+    samples += t.occupancy[i];
+  fprintf(stream, "Buffer occupancy --> samples=%ld\n", samples);
+  for (int i = 0; i < INSTR_OCCUPANCY_BINS; i++) {
+    if (i < INSTR_OCCUPANCY_BINS - 1)
+      fprintf(stream, "  %2d-%2d%%: %ld\n", i * 10, i * 10 + 9, t.occupancy[i]);
+    else
+      fprintf(stream, "    full: %ld\n", t.occupancy[i]);
+  }
+
+  fprintf(stream, "Incompatible matrices discarded per multiplication:\n");
+  for (int i = 0; i < INSTR_DISCARD_BINS; i++) {
+    if (t.discards[i] == 0)
+      continue;
+    fprintf(stream, "  %2d%s: %ld\n", i, i == INSTR_DISCARD_BINS - 1 ? "+" : " ", t.discards[i]);
+  }
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ *  instrument header
+ *  Function prototypes, data, and constants for hot-path instrumentation module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// HOT-PATH INSTRUMENTATION
+// Compiled in only when INSTRUMENT is nonzero (see pcmatrix.h and the
+// pcMatrix-stats target); otherwise every call below is a plain
+// pthread_mutex_lock()/unlock() or expands to nothing.
+
+// Histogram sizes: buffer occupancy in tenths of BOUNDED_BUFFER_SIZE (last bin is full),
+// and incompatible matrices discarded per multiplication (last bin is "or more")
+#define INSTR_OCCUPANCY_BINS 11
+#define INSTR_DISCARD_BINS 17
+
+#if INSTRUMENT
+void instr_lock(pthread_mutex_t *m);
+void instr_unlock(pthread_mutex_t *m);
+long long instr_wait_begin();
+void instr_wait_end(long long start);
+void instr_occupancy(int count, int size);
+void instr_discards(int n);
+void InstrReport(FILE *stream);
+#else
+#define instr_lock(m) pthread_mutex_lock(m)
+#define instr_unlock(m) pthread_mutex_unlock(m)
+#define instr_wait_begin() 0
+#define instr_wait_end(start) ((void)(start))
+#define instr_occupancy(count, size) ((void)0)
+#define instr_discards(n) ((void)(n))
+#define InstrReport(stream) ((void)0)
+#endif
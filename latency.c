@@ -0,0 +1,199 @@
+/*
+ *  Per-matrix latency routines
+ *  HDR histograms of queueing and end-to-end latency
+ *
+ *  Matrices are stamped when generated and when put in the buffer. Every
+ *  thread records the latencies it observes in its own histograms, with
+ *  no locking; histograms are linked into a registry on first use and
+ *  merged by LatencyReport(). The histograms are HDR style: buckets are
+ *  linear within each power of two, so they cover nanoseconds to minutes
+ *  in a fixed, small array with a bounded relative error.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+#include "coop.h"
+#include "latency.h"
+
+/**
+ * @file latency.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+#define SUB_HALF (1 << (HDR_SUB_BITS - 1))
+
+static const char *kind_names[LAT_KINDS] = {
+  "queue (put to get)", "pair (get to product)", "end to end (generated to product)"
+};
+
+/**
+ * @brief Histograms of one thread
+ */
+typedef struct latency_stats {
+  Hdr hist[LAT_KINDS];
+  struct latency_stats *next;
+} LatencyStats;
+
+/** Registry of every thread's histograms */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static LatencyStats *registry = NULL;
+
+static __thread LatencyStats *mine = NULL;
+
+/**
+ * @brief Histograms of the calling thread, registered on first use
+ */
+COOP_TLS_ACCESSOR LatencyStats *stats()
+{
+  if (mine == NULL) {
+    mine = (LatencyStats *)malloc(sizeof(LatencyStats));
+    assert(mine != NULL);
+    for (int k = 0; k < LAT_KINDS; k++)
+      HdrInit(&mine->hist[k]);
+    pthread_mutex_lock(&registry_lock);
+    mine->next = registry;
+    registry = mine;
+    pthread_mutex_unlock(&registry_lock);
+  }
+  return mine;
+}
+
+/**
+ * @brief Index of the bucket counting value
+ */
+static int hdr_index(long long value)
+{
+  unsigned long long v = value < 0 ? 0 : (unsigned long long)value;
+  if (v >> HDR_MAX_BITS)
+    return HDR_COUNTS - 1;
+  // power-of-two bucket, then the linear sub-bucket within it
+  int bucket = (64 - __builtin_clzll(v | ((1ULL << HDR_SUB_BITS) - 1))) - HDR_SUB_BITS;
+  int sub = (int)(v >> bucket);
+  return ((bucket + 1) << (HDR_SUB_BITS - 1)) + (sub - SUB_HALF);
+}
+
+/**
+ * @brief Largest value counted by the bucket at index
+ */
+static long long hdr_value(int index)
+{
+  int bucket = (index >> (HDR_SUB_BITS - 1)) - 1;
+  long long sub = (index & (SUB_HALF - 1)) + SUB_HALF;
+  if (bucket < 0) {
+    sub -= SUB_HALF;
+    bucket = 0;
+  }
+  return ((sub + 1) << bucket) - 1;
+}
+
+/**
+ * @brief Empties a histogram
+ */
+void HdrInit(Hdr *h)
+{
+  memset(h, 0, sizeof(Hdr));
+}
+
+/**
+ * @brief Counts one value
+ */
+void HdrRecord(Hdr *h, long long value)
+{
+  if (h->count == 0 || value < h->min)
+    h->min = value;
+  if (h->count == 0 || value > h->max)
+    h->max = value;
+  h->count++;
+  h->counts[hdr_index(value)]++;
+}
+
+/**
+ * @brief Adds every value counted by from into into
+ */
+void HdrMerge(Hdr *into, Hdr *from)
+{
+  if (from->count == 0)
+    return;
+  if (into->count == 0 || from->min < into->min)
+    into->min = from->min;
+  if (into->count == 0 || from->max > into->max)
+    into->max = from->max;
+  into->count += from->count;
+  for (int i = 0; i < HDR_COUNTS; i++)
+    into->counts[i] += from->counts[i];
+}
+
+/**
+ * @brief Value at or below which p percent of the counted values fall
+ *
+ * @return Upper bound of the bucket holding that rank, capped at the exact maximum
+ */
+long long HdrPercentile(Hdr *h, double p)
+{
+  if (h->count == 0)
+    return 0;
+  long long rank = (long long)(p / 100.0 * h->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  long long seen = 0;
+  for (int i = 0; i < HDR_COUNTS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      long long v = hdr_value(i);
+      return v < h->max ? v : h->max;
+    }
+  }
+  return h->max;
+}
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds, the clock every module times with
+ */
+long long LatencyNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Records the latency from start until now in the calling thread's histogram
+ *
+ * @param kind LAT_* latency being measured
+ * @param start Stamp taken with LatencyNow()
+ */
+void LatencyRecord(int kind, long long start)
+{
+  HdrRecord(&stats()->hist[kind], LatencyNow() - start);
+}
+
+/**
+ * @brief Merges every thread's histograms and prints their percentiles
+ */
+void LatencyReport(FILE *stream)
+{
+  Hdr *total = (Hdr *)malloc(sizeof(Hdr));
+  assert(total != NULL);
+  for (int k = 0; k < LAT_KINDS; k++) {
+    HdrInit(total);
+    pthread_mutex_lock(&registry_lock);
+    for (LatencyStats *s = registry; s != NULL; s = s->next)
+      HdrMerge(total, &s->hist[k]);
+    pthread_mutex_unlock(&registry_lock);
+    fprintf(stream, "Latency %-34s --> count=%lld p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus\n",
+            kind_names[k], total->count,
+            HdrPercentile(total, 50) / 1e3, HdrPercentile(total, 99) / 1e3,
+            HdrPercentile(total, 99.9) / 1e3, total->max / 1e3);
+  }
+  free(total);
+}
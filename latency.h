@@ -0,0 +1,45 @@
+/*
+ *  latency header
+ *  Function prototypes, data, and constants for per-matrix latency module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// PER-MATRIX LATENCY (HDR histograms)
+
+// Histogram precision: 2^HDR_SUB_BITS linear sub-buckets per power of two,
+// so a recorded value is off by less than 1 part in 2^(HDR_SUB_BITS-1)
+#define HDR_SUB_BITS 8
+// Largest value tracked exactly, as a power of two nanoseconds (~18 minutes);
+// larger values are counted in the last bucket
+#define HDR_MAX_BITS 40
+#define HDR_COUNTS ((HDR_MAX_BITS - HDR_SUB_BITS + 2) << (HDR_SUB_BITS - 1))
+
+// Recorded latencies
+// LAT_QUEUE - matrix waiting in the bounded buffer, put() to get()
+// LAT_PAIR  - first operand taken from the buffer to product done
+// LAT_E2E   - oldest operand generated to product done
+#define LAT_QUEUE 0
+#define LAT_PAIR 1
+#define LAT_E2E 2
+#define LAT_KINDS 3
+
+// High dynamic range histogram of nanosecond values
+typedef struct hdr {
+  long long count;
+  long long min;
+  long long max;
+  long long counts[HDR_COUNTS];
+} Hdr;
+
+// histogram methods
+void HdrInit(Hdr *h);
+void HdrRecord(Hdr *h, long long value);
+void HdrMerge(Hdr *into, Hdr *from);
+long long HdrPercentile(Hdr *h, double p);
+
+// latency methods
+long long LatencyNow();
+void LatencyRecord(int kind, long long start);
+void LatencyReport(FILE *stream);
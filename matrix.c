@@ -15,14 +15,117 @@
 #include <sched.h>
 #include <string.h>
 #include <time.h>
+#include "arena.h"
+#include "pool.h"
+#include "sparse.h"
 #include "matrix.h"
+#include "memory.h"
 #include "pcmatrix.h"
+#include "coop.h"
 
+/**
+ * @brief Free list of a thread's MATRIX_SMALL matrices
+ */
+typedef struct small_list {
+  Matrix * head;  // linked through the m field
+  int n;
+  int elems;      // MatrixSmallElems() of the blocks on the list
+  int registered; // released by small_release() when the thread exits
+} SmallList;
+
+static __thread SmallList small_free = { NULL, 0, 0, 0 };
+static pthread_once_t small_once = PTHREAD_ONCE_INIT;
+static pthread_key_t small_key;
+
+// Frees the small matrices a thread kept, when it exits
+static void small_release(void * arg)
+{
+  SmallList * list = (SmallList *) arg;
+  while (list->head != NULL)
+  {
+    Matrix * next = (Matrix *) list->head->m;
+    free(list->head);
+    list->head = next;
+  }
+  list->n = 0;
+}
+
+// Elements of a MATRIX_SMALL block
+int MatrixSmallElems()
+{
+  return INLINE_MAX > SMALL_MIN_ELEMS ? INLINE_MAX : SMALL_MIN_ELEMS;
+}
+
+static void small_key_init()
+{
+  pthread_key_create(&small_key, small_release);
+}
+
+COOP_TLS_ACCESSOR SmallList * small_list()
+{
+  if (!small_free.registered)
+  {
+    pthread_once(&small_once, small_key_init);
+    pthread_setspecific(small_key, &small_free);
+    small_free.registered = 1;
+  }
+  return &small_free;
+}
+
+// Allocates an r x c matrix of at most MatrixSmallElems() elements in one
+// block, reusing one this thread freed if it can
+static Matrix * small_block(int r, int c)
+{
+  SmallList * list = small_list();
+  int elems = MatrixSmallElems();
+  if (list->elems != elems)
+  {
+    // INLINE_MAX changed between runs (see tune.c): the kept blocks are the wrong size
+    small_release(list);
+    list->elems = elems;
+  }
+  Matrix * mat = list->head;
+  if (mat != NULL)
+  {
+    list->head = (Matrix *) mat->m;
+    list->n--;
+  }
+  else
+  {
+    // Room for up to elems row pointers, since a matrix can be elems x 1
+    mat = (Matrix *) malloc(sizeof(Matrix) + (sizeof(int *) + sizeof(int)) * elems);
+    assert(mat != 0);
+  }
+  int ** a = (int **) (mat + 1);
+  int * data = (int *) (a + elems);
+  for (int i = 0; i < r; i++)
+  {
+    a[i] = data + i * c;
+  }
+  mat->m=a;
+  mat->rows=r;
+  mat->cols=c;
+  mat->storage=MATRIX_SMALL;
+  mat->csr=NULL;
+  return mat;
+}
+
+// Counts a new matrix when MEMORY_STATS is set
+static inline Matrix * accounted(Matrix * mat)
+{
+  if (MEMORY_STATS)
+    MemoryAlloc(MatrixBytes(mat));
+  return mat;
+}
 
 // MATRIX ROUTINES
 Matrix * AllocMatrix(int r, int c)
 {
-  Matrix * mat;
+  Matrix * mat = PoolAllocMatrix(r, c);
+  if (mat != NULL)
+    return accounted(mat);
+  if (INLINE_MAX > 0 && r * c <= INLINE_MAX)
+    return accounted(small_block(r, c));
   mat = (Matrix *) malloc(sizeof(Matrix));
   int ** a;
   int i;
@@ -36,6 +139,57 @@ Matrix * AllocMatrix(int r, int c)
   mat->m=a;
   mat->rows=r;
   mat->cols=c;
+  mat->storage=MATRIX_HEAP;
+  mat->csr=NULL;
+  return accounted(mat);
+}
+
+// Allocates an r x c matrix of at most MatrixSmallElems() elements whatever
+// INLINE_MAX is, its rows consecutive in one block: from the huge-page pool
+// when it is set, else MATRIX_SMALL storage the thread recycles
+Matrix * AllocSmallMatrix(int r, int c)
+{
+  assert(r * c <= MatrixSmallElems());
+  Matrix * mat = PoolAllocMatrix(r, c);
+  if (mat == NULL)
+    mat = small_block(r, c);
+  return accounted(mat);
+}
+
+// Wraps r x c row-major elements owned by someone else, without copying them
+Matrix * AllocMatrixView(int r, int c, int * data)
+{
+  Matrix * mat = (Matrix *) malloc(sizeof(Matrix));
+  int ** a = (int **) malloc(sizeof(int *) * r);
+  assert(mat != 0 && a != 0);
+  int i;
+  for (i = 0; i < r; i++)
+  {
+    a[i] = data + (size_t) i * c;
+  }
+  mat->m=a;
+  mat->rows=r;
+  mat->cols=c;
+  mat->storage=MATRIX_VIEW;
+  mat->csr=NULL;
+  return accounted(mat);
+}
+
+Matrix * ArenaAllocMatrix(Arena * a, int r, int c)
+{
+  Matrix * mat = (Matrix *) ArenaAlloc(a, sizeof(Matrix));
+  int ** rows = (int **) ArenaAlloc(a, sizeof(int *) * r);
+  int * data = (int *) ArenaAlloc(a, sizeof(int) * r * c);
+  int i;
+  for (i = 0; i < r; i++)
+  {
+    rows[i] = data + i * c;
+  }
+  mat->m=rows;
+  mat->rows=r;
+  mat->cols=c;
+  mat->storage=MATRIX_ARENA;
+  mat->csr=NULL;
   return mat;
 }
 
@@ -45,9 +199,41 @@ void FreeMatrix(Matrix * mat)
   //int c = mat->cols;
   int **a = mat->m;
   int i;
-  for (i=0; i<r; i++)
+  if (mat->storage == MATRIX_ARENA)
+    return;
+  if (MEMORY_STATS)
+    MemoryFree(MatrixBytes(mat));
+  if (mat->csr != NULL)
+  {
+    free(mat);  // header and CSR arrays share one block
+    return;
+  }
+  if (mat->storage == MATRIX_POOL)
   {
-    free(a[i]);
+    PoolFree(mat);
+    return;
+  }
+  if (mat->storage == MATRIX_SMALL)
+  {
+    SmallList * list = small_list();
+    if (list->n < SMALL_FREE_MAX)
+    {
+      mat->m = (int **) list->head;
+      list->head = mat;
+      list->n++;
+    }
+    else
+    {
+      free(mat);
+    }
+    return;
+  }
+  if (mat->storage == MATRIX_HEAP)
+  {
+    for (i=0; i<r; i++)
+    {
+      free(a[i]);
+    }
   }
   free(a);
   free(mat);
@@ -64,7 +250,9 @@ void GenMatrix(Matrix * mat)
     for (j = 0; j < width; j++)
     {
       int * mm = a[i];
-      if (MATRIX_MODE == 0)
+      if (SPARSE_DENSITY > 0 && SPARSE_DENSITY < 100 && rand() % 100 >= SPARSE_DENSITY)
+        mm[j] = 0;
+      else if (MATRIX_MODE == 0)
         mm[j] = 1 + rand() % 10;
       else
         mm[j] = 1;
@@ -91,6 +279,8 @@ Matrix * GenMatrixRandom()
   }
   Matrix * mat = AllocMatrix(row, col);
   GenMatrix(mat);
+  if (SPARSE_DENSITY > 0)
+    mat = ChooseStorage(mat);
   return mat;
 }
 
@@ -102,23 +292,87 @@ Matrix * GenMatrixBySize(int row, int col)
   return mat;
 }
 
+Matrix * CopyMatrix(Matrix * mat)
+{
+  if (mat->csr != NULL)
+  {
+    Matrix * sp = AllocSparseMatrix(mat->rows, mat->cols, mat->csr->nnz);
+    memcpy(sp->csr->rowptr, mat->csr->rowptr, sizeof(int) * (mat->rows + 1 + 2 * (size_t) mat->csr->nnz));
+    return sp;
+  }
+  Matrix * copy = AllocMatrix(mat->rows, mat->cols);
+  for (int i = 0; i < mat->rows; i++)
+  {
+    memcpy(copy->m[i], mat->m[i], sizeof(int) * mat->cols);
+  }
+  return copy;
+}
+
+// Returns 1 if both matrices have the same shape and elements
+int MatrixEqual(Matrix * m1, Matrix * m2)
+{
+  if ((m1->rows != m2->rows) || (m1->cols != m2->cols))
+    return 0;
+  if ((m1->csr != NULL) || (m2->csr != NULL))
+  {
+    int * r1 = (int *)coop_scratch(sizeof(int) * 2 * (size_t)m1->cols);
+    int * r2 = r1 + m1->cols;
+    int equal = 1;
+    for (int i = 0; i < m1->rows && equal; i++)
+    {
+      MatrixRow(m1, i, r1);
+      MatrixRow(m2, i, r2);
+      equal = memcmp(r1, r2, sizeof(int) * m1->cols) == 0;
+    }
+    free(r1);
+    return equal;
+  }
+  for (int i = 0; i < m1->rows; i++)
+  {
+    if (memcmp(m1->m[i], m2->m[i], sizeof(int) * m1->cols) != 0)
+      return 0;
+  }
+  return 1;
+}
+
 Matrix * MatrixMultiply(Matrix * m1, Matrix * m2)
 {
   if ((m1==NULL) || (m2==NULL))
     printf("m1=%p  m2=%p!\n",m1,m2);
-  int sum=0;
   if (m1->cols != m2->rows)
   {
     return NULL;
   }
-  printf("MULTIPLY (%d x %d) BY (%d x %d):\n",m1->rows,m1->cols,m2->rows,m2->cols);
+  if (SHOW_RESULTS)
+    printf("MULTIPLY (%d x %d) BY (%d x %d):\n",m1->rows,m1->cols,m2->rows,m2->cols);
+  if ((m1->csr != NULL) || (m2->csr != NULL))
+    return SparseMultiply(m1, m2);
   Matrix * newmat = AllocMatrix(m1->rows, m2->cols);
-  int ** nm = newmat->m;
+  MatrixMultiplyInto(m1, m2, newmat);
+  return newmat;
+}
+
+// Multiplies m1 by m2 into a preallocated (m1->rows x m2->cols) matrix
+void MatrixMultiplyInto(Matrix * m1, Matrix * m2, Matrix * out)
+{
+  if ((m1->csr != NULL) || (m2->csr != NULL))
+  {
+    SparseMultiplyInto(m1, m2, out);
+    return;
+  }
+  MatrixMultiplyRows(m1, m2, out, 0, out->rows);
+}
+
+// Computes rows lo to hi - 1 of the dense product m1 x m2 into out
+void MatrixMultiplyRows(Matrix * m1, Matrix * m2, Matrix * out, int lo, int hi)
+{
+  int sum=0;
+  int ** nm = out->m;
   int ** ma1 = m1->m;
   int ** ma2 = m2->m;
-  for (int c=0;c<newmat->rows;c++)
+  for (int c=lo;c<hi;c++)
   {
-    for (int d=0;d<newmat->cols;d++)
+    for (int d=0;d<out->cols;d++)
     {
       for (int k=0;k<m2->rows;k++)
       {
@@ -128,16 +382,30 @@ Matrix * MatrixMultiply(Matrix * m1, Matrix * m2)
       sum=0;
     }
   }
-  return newmat;
 }
 
 void DisplayMatrix(Matrix * mat, FILE *stream)
 {
-  if ((mat == NULL) || (mat->m == NULL))
+  if ((mat == NULL) || ((mat->m == NULL) && (mat->csr == NULL)))
   {
     printf("DisplayMatrix: EMPTY matrix\n");
     return;
   }
+  if (mat->csr != NULL)
+  {
+    // Sparse rows are expanded one at a time, printing the zeros they omit
+    int * row = (int *)coop_scratch(sizeof(int) * (size_t)mat->cols);
+    for (int i=0; i<mat->rows; i++)
+    {
+      MatrixRow(mat, i, row);
+      fprintf(stream, "|");
+      for (int j=0; j<mat->cols; j++)
+        fprintf(stream, j==0 ? "%3d" : " %3d", row[j]);
+      fprintf(stream, "|\n");
+    }
+    free(row);
+    return;
+  }
   int ** matrix = mat->m;
   int height = mat->rows;
   int width = mat->cols;
@@ -162,6 +430,13 @@ void DisplayMatrix(Matrix * mat, FILE *stream)
 
 int AvgElement(Matrix * mat) // int ** matrix, const int height, const int width)
 {
+  if (mat->csr != NULL)
+  {
+    int x = SumMatrix(mat);
+    int ele = mat->rows * mat->cols;
+    printf("x=%d ele=%d\n",x, ele);
+    return x / ele;
+  }
   int ** a = mat->m;
   int height = mat->rows;
   int width = mat->cols;
@@ -185,6 +460,13 @@ int AvgElement(Matrix * mat) // int ** matrix, const int height, const int width
 }
 
 int SumMatrix(Matrix * mat) {
+   if (mat->csr != NULL)
+   {
+      int total = 0;
+      for (int k = 0; k < mat->csr->nnz; k++)
+         total += mat->csr->vals[k];
+      return total;
+   }
    int ** a = mat->m;
    int height = mat->rows;
    int width = mat->cols;
@@ -203,3 +485,71 @@ int SumMatrix(Matrix * mat) {
    }
    return total;
 }
+
+// Computes out = u x mat for a row vector u of mat->rows elements, wrapping
+static void RowTimesMatrix(const unsigned * u, Matrix * mat, unsigned * out)
+{
+  memset(out, 0, sizeof(unsigned) * mat->cols);
+  if (mat->csr != NULL)
+  {
+    Csr * s = mat->csr;
+    for (int i = 0; i < mat->rows; i++)
+      for (int p = s->rowptr[i]; p < s->rowptr[i + 1]; p++)
+        out[s->colidx[p]] += u[i] * (unsigned)s->vals[p];
+    return;
+  }
+  for (int i = 0; i < mat->rows; i++)
+  {
+    const int * row = mat->m[i];
+    for (int j = 0; j < mat->cols; j++)
+      out[j] += u[i] * (unsigned)row[j];
+  }
+}
+
+// Sum of the elements of the product factors[0] x ... x factors[n - 1],
+// as SumMatrix would return for it, without computing the product.
+// The element sum of A x B is (column sums of A) . (row sums of B); a
+// chain carries the row vector 1 x A1 x ... x An-1 from left to right and
+// ends with the row sums of An. That is O(rows x cols) work per factor
+// instead of the O(n^3) of a multiply. Sums wrap as the product's do.
+int SumProduct(Matrix ** factors, int n)
+{
+  int len = 1;
+  for (int f = 0; f < n; f++)
+    if (factors[f]->cols > len)
+      len = factors[f]->cols;
+  if (factors[0]->rows > len)
+    len = factors[0]->rows;
+  unsigned * u = (unsigned *)coop_scratch(sizeof(unsigned) * 2 * (size_t)len);
+  unsigned * v = u + len;
+
+  // Column sums of A1, then times A2 .. An-1
+  for (int i = 0; i < factors[0]->rows; i++)
+    u[i] = 1;
+  for (int f = 0; f < n - 1; f++)
+  {
+    RowTimesMatrix(u, factors[f], v);
+    memcpy(u, v, sizeof(unsigned) * factors[f]->cols);
+  }
+
+  // Dot product with the row sums of An
+  Matrix * last = factors[n - 1];
+  unsigned total = 0;
+  for (int i = 0; i < last->rows; i++)
+  {
+    unsigned rowsum = 0;
+    if (last->csr != NULL)
+    {
+      for (int p = last->csr->rowptr[i]; p < last->csr->rowptr[i + 1]; p++)
+        rowsum += (unsigned)last->csr->vals[p];
+    }
+    else
+    {
+      for (int j = 0; j < last->cols; j++)
+        rowsum += (unsigned)last->m[i][j];
+    }
+    total += u[i] * rowsum;
+  }
+  free(u);
+  return (int)total;
+}
@@ -9,10 +9,34 @@
 #define ROW 5
 #define COL 5
 
+// Where a matrix's elements live, which decides what FreeMatrix releases
+// MATRIX_HEAP  - rows malloc'ed by AllocMatrix
+// MATRIX_ARENA - carved from a scratch arena, released with the arena
+// MATRIX_VIEW  - borrowed storage (e.g. a mapped input file), not owned
+// MATRIX_POOL  - a slot of the huge-page matrix pool, returned to the pool
+// MATRIX_SMALL - header, rows and elements in one block of MatrixSmallElems()
+//                elements, kept on the freeing thread's free list for reuse
+#define MATRIX_HEAP 0
+#define MATRIX_ARENA 1
+#define MATRIX_VIEW 2
+#define MATRIX_POOL 3
+#define MATRIX_SMALL 4
+
+// Small matrices a thread keeps for reuse before freeing them for real
+#define SMALL_FREE_MAX 1024
+
+// Fewest elements a MATRIX_SMALL block holds, INLINE_MAX permitting more:
+// enough for any batched product (see batch.h)
+#define SMALL_MIN_ELEMS 16
+
 typedef struct matrix {
   int rows;
   int cols;
   int ** m;
+  int storage;
+  struct csr * csr;  // nonzero elements when stored sparsely (see sparse.h), m is NULL then
+  long long born;    // generation time, stamped by producers when LATENCY is set
+  long long queued;  // time put() placed it in the bounded buffer, when LATENCY is set
 } Matrix;
 
 //extern int theseed;
@@ -24,6 +48,18 @@ void GenMatrix(Matrix * mat);
 Matrix * GenMatrixRandom();
 int AvgElement(Matrix * mat);
 int SumMatrix(Matrix * mat);
+int SumProduct(Matrix ** factors, int n);
 Matrix * MatrixMultiply(Matrix * m1, Matrix * m2);
 void DisplayMatrix(Matrix * mat, FILE *stream);
 Matrix * GenMatrixBySize(int row, int col);
+Matrix * AllocMatrixView(int r, int c, int * data);
+Matrix * CopyMatrix(Matrix * mat);
+int MatrixEqual(Matrix * m1, Matrix * m2);
+Matrix * AllocSmallMatrix(int r, int c);
+int MatrixSmallElems();
+
+// Allocation from a scratch arena (see arena.h); never passed to FreeMatrix
+struct arena;
+Matrix * ArenaAllocMatrix(struct arena *a, int r, int c);
+void MatrixMultiplyInto(Matrix * m1, Matrix * m2, Matrix * out);
+void MatrixMultiplyRows(Matrix * m1, Matrix * m2, Matrix * out, int lo, int hi);
@@ -0,0 +1,243 @@
+/*
+ *  Memory accounting routines
+ *  Tracks live matrix memory by where it is held, and the process RSS
+ *
+ *  With MEMORY_STATS set, every matrix allocation and free is counted
+ *  against the place of the calling thread: a producer, a consumer or
+ *  anything else. put() and get() move a matrix's bytes from its
+ *  producer to the buffer and from the buffer to its consumer, so the
+ *  live bytes of each place show whether memory is held by the buffer,
+ *  by matrices generated but not yet put, or by pairs and products in
+ *  flight. The process RSS beyond the peak of live matrices is what
+ *  the allocator, the free lists, thread stacks and the pool keep.
+ *
+ *  Counters are shared atomics, so accounting costs a few atomic adds
+ *  per matrix; nothing is counted unless MEMORY_STATS is set.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "matrix.h"
+#include "sparse.h"
+#include "pcmatrix.h"
+#include "memory.h"
+
+/**
+ * @file memory.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Counters of one place, on a cache line of their own
+ */
+typedef struct mem_place {
+  long long bytes;        /**< live bytes held here */
+  long long peak;         /**< most live bytes held here */
+  long long allocs;       /**< matrices allocated by threads of this place */
+  long long alloc_bytes;
+} __attribute__((aligned(64))) MemPlace;
+
+static const char *place_names[MEM_PLACES] = { "other", "producers", "buffer", "consumers" };
+
+static MemPlace places[MEM_PLACES];
+static MemPlace total;
+static long long live_matrices = 0;
+/** Bytes of buffer storage (pointer array, slots, heap keys), now and at most */
+static long long storage = 0;
+static long long storage_peak = 0;
+/** Highest RSS read by MemoryRSS(), e.g. in progress snapshots */
+static long long rss_peak = 0;
+
+/** Place of the calling thread, set by MemoryRole() */
+static __thread int role = MEM_OTHER;
+
+/**
+ * @brief Raises a peak to value if it is higher
+ */
+static void raise_peak(long long *peak, long long value)
+{
+  long long p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+  while (value > p && !__atomic_compare_exchange_n(peak, &p, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/**
+ * @brief Adds bytes to a place's live bytes
+ */
+static void add(MemPlace *p, long long bytes)
+{
+  long long now = __atomic_add_fetch(&p->bytes, bytes, __ATOMIC_RELAXED);
+  if (bytes > 0)
+    raise_peak(&p->peak, now);
+}
+
+/**
+ * @brief Bytes a matrix occupies: header, row pointers and elements it owns
+ *
+ * Arena matrices are released with their arena and count as 0.
+ */
+long long MatrixBytes(Matrix *mat)
+{
+  long long head = sizeof(Matrix) + sizeof(int *) * (long long)mat->rows;
+  if (mat->csr != NULL)
+    return sizeof(Matrix) + sizeof(Csr) + sizeof(int) * ((long long)mat->rows + 1 + 2LL * mat->csr->nnz);
+  switch (mat->storage) {
+    case MATRIX_ARENA:
+      return 0;
+    case MATRIX_VIEW:
+      return head;
+    case MATRIX_SMALL:
+      return sizeof(Matrix) + (sizeof(int *) + sizeof(int)) * (long long)MatrixSmallElems();
+    default:
+      return head + sizeof(int) * (long long)mat->rows * mat->cols;
+  }
+}
+
+/**
+ * @brief Sets the place the calling thread's allocations are counted against
+ *
+ * Producers and consumers call it when they start, and again after every
+ * wait, since cooperative tasks can resume on another thread.
+ */
+void MemoryRole(int place)
+{
+  role = place;
+}
+
+/**
+ * @brief Counts a new matrix of the given size against the caller's place
+ */
+void MemoryAlloc(long long bytes)
+{
+  MemPlace *p = &places[role];
+  __atomic_fetch_add(&p->allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&p->alloc_bytes, bytes, __ATOMIC_RELAXED);
+  add(p, bytes);
+  __atomic_fetch_add(&total.allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&total.alloc_bytes, bytes, __ATOMIC_RELAXED);
+  add(&total, bytes);
+  __atomic_fetch_add(&live_matrices, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Counts a freed matrix of the given size against the caller's place
+ */
+void MemoryFree(long long bytes)
+{
+  add(&places[role], -bytes);
+  add(&total, -bytes);
+  __atomic_fetch_sub(&live_matrices, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Moves a live matrix's bytes from one place to another
+ */
+void MemoryMove(int from, int to, long long bytes)
+{
+  add(&places[from], -bytes);
+  add(&places[to], bytes);
+}
+
+/**
+ * @brief Adds to (or, negative, removes from) the buffer storage in use
+ */
+void MemoryStorage(long long bytes)
+{
+  long long now = __atomic_add_fetch(&storage, bytes, __ATOMIC_RELAXED);
+  if (bytes > 0)
+    raise_peak(&storage_peak, now);
+}
+
+/**
+ * @brief Current totals, for progress reports
+ */
+void MemorySnapshot(MemoryUsage *u)
+{
+  u->matrices = __atomic_load_n(&live_matrices, __ATOMIC_RELAXED);
+  u->bytes = __atomic_load_n(&total.bytes, __ATOMIC_RELAXED);
+  u->peak = __atomic_load_n(&total.peak, __ATOMIC_RELAXED);
+  u->rss = MemoryRSS();
+}
+
+/**
+ * @brief Resident set size of the process, read from /proc/self/statm
+ *
+ * Every reading also raises the RSS peak MemoryPeakRSS() reports.
+ *
+ * @return Bytes, or -1 if unavailable
+ */
+long long MemoryRSS()
+{
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL)
+    return -1;
+  long long size, resident;
+  int n = fscanf(f, "%lld %lld", &size, &resident);
+  fclose(f);
+  if (n != 2)
+    return -1;
+  long long rss = resident * sysconf(_SC_PAGESIZE);
+  raise_peak(&rss_peak, rss);
+  return rss;
+}
+
+/**
+ * @brief Largest resident set size the process has had
+ *
+ * The kernel updates getrusage()'s ru_maxrss lazily, so it can lag
+ * behind the current RSS; the result is never below the current RSS or
+ * any RSS read earlier by MemoryRSS().
+ *
+ * @return Bytes, or -1 if unavailable
+ */
+long long MemoryPeakRSS()
+{
+  long long peak = -1;
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    peak = (long long)ru.ru_maxrss * 1024;
+  MemoryRSS();
+  long long seen = __atomic_load_n(&rss_peak, __ATOMIC_RELAXED);
+  return seen > peak ? seen : peak;
+}
+
+static double mib(long long bytes)
+{
+  return bytes / (1024.0 * 1024.0);
+}
+
+/**
+ * @brief Prints live and peak memory by place, allocation rates and RSS
+ *
+ * @param seconds Duration of the run for allocation rates, or 0 to omit them
+ */
+void MemoryReport(FILE *stream, double seconds)
+{
+  fprintf(stream, "Matrix memory --> live=%lld matrices (%.2f MiB) peak=%.2f MiB allocated=%lld (%.2f MiB)\n",
+          live_matrices, mib(total.bytes), mib(total.peak), total.allocs, mib(total.alloc_bytes));
+  for (int i = 0; i < MEM_PLACES; i++) {
+    MemPlace *p = &places[i];
+    fprintf(stream, "Matrix memory %-9s --> live=%.2f MiB peak=%.2f MiB", place_names[i],
+            mib(p->bytes), mib(p->peak));
+    if (i == MEM_BUFFER)
+      fprintf(stream, " plus storage peak=%.2f MiB", mib(storage_peak));
+    else if (seconds > 0)
+      fprintf(stream, " allocs=%lld (%.0f/s, %.2f MiB/s)", p->allocs, p->allocs / seconds, mib(p->alloc_bytes) / seconds);
+    else
+      fprintf(stream, " allocs=%lld", p->allocs);
+    fprintf(stream, "\n");
+  }
+  long long rss = MemoryRSS(), peak_rss = MemoryPeakRSS();
+  if (peak_rss <= 0)
+    return;
+  fprintf(stream, "Process memory --> RSS=%.2f MiB peak RSS=%.2f MiB, %.2f MiB above peak live matrices"
+          " (allocator, free lists, stacks, pool)\n", mib(rss), mib(peak_rss), mib(peak_rss - total.peak));
+}
@@ -0,0 +1,45 @@
+/*
+ *  memory header
+ *  Function prototypes, data, and constants for memory accounting module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// MEMORY ACCOUNTING (live matrix bytes by place, process RSS)
+
+// Places matrix memory is accounted to
+// MEM_OTHER    - allocated outside producers and consumers (main thread, callers)
+// MEM_PRODUCER - generated by a producer and not yet put in the buffer
+// MEM_BUFFER   - held by the bounded buffer, put() to get()
+// MEM_CONSUMER - taken by a consumer, or allocated by it (products)
+#define MEM_OTHER 0
+#define MEM_PRODUCER 1
+#define MEM_BUFFER 2
+#define MEM_CONSUMER 3
+#define MEM_PLACES 4
+
+// Snapshot of the totals, for progress reports
+// matrices/bytes - live matrices and their bytes
+// peak           - most live bytes so far
+// rss            - resident set size of the process now, -1 if unknown
+typedef struct memory_usage {
+  long long matrices;
+  long long bytes;
+  long long peak;
+  long long rss;
+} MemoryUsage;
+
+struct matrix;
+
+// memory methods
+long long MatrixBytes(struct matrix *mat);
+void MemoryRole(int place);
+void MemoryAlloc(long long bytes);
+void MemoryFree(long long bytes);
+void MemoryMove(int from, int to, long long bytes);
+void MemoryStorage(long long bytes);
+void MemorySnapshot(MemoryUsage *u);
+long long MemoryRSS();
+long long MemoryPeakRSS();
+void MemoryReport(FILE *stream, double seconds);
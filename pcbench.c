@@ -0,0 +1,467 @@
+/*
+ *  pcbench module
+ *  In-process benchmark driver for the pcMatrix pipeline
+ *
+ *  Runs the producer/consumer pipeline repeatedly inside one process over
+ *  a grid of worker counts, buffer sizes, matrix counts and matrix modes.
+ *  Each configuration gets warm-up runs followed by measured runs timed
+ *  with CLOCK_MONOTONIC; results are printed as CSV or JSON with
+ *  percentiles and throughput. Products are not printed, so the numbers
+ *  exclude process startup and output cost.
+ *
+ *  With -a, it autotunes instead: the worker counts and buffer sizes of
+ *  the grid (or defaults for the host), batch sizes, inline slots and work
+ *  stealing are searched with successive halving (see tune.c), and the
+ *  winner is written as a profile that pcMatrix -U loads.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+/**
+ * @file pcbench.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "matrix.h"
+#include "coop.h"
+#include "pcmatrix.h"
+#include "prodcons.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "workload.h"
+#include "batch.h"
+#include "verify.h"
+#include "tune.h"
+#include "memory.h"
+#include "latency.h"
+
+// Maximum number of values in one grid dimension
+#define MAX_GRID 32
+
+// Matrices per run of the last autotuning round unless -n is given
+#define TUNE_MATRICES 20000
+
+// Output formats
+#define FORMAT_CSV 0
+#define FORMAT_JSON 1
+
+/**
+ * @brief Values of one grid dimension, parsed from a comma separated list
+ */
+typedef struct grid {
+  int n;
+  int v[MAX_GRID];
+} Grid;
+
+/**
+ * @brief Summary of the measured runs of one configuration
+ */
+typedef struct result {
+  double mean, min, max, p50, p90, p99;  /**< run times in milliseconds */
+  double matrices_per_s;                 /**< consumed matrices per second of the median run */
+  double mults_per_s;                    /**< multiplications per second of the median run */
+  int multiplied;                        /**< multiplications in the median run */
+} Result;
+
+/**
+ * @brief Prints command line usage
+ *
+ * @param prog Program name (argv[0])
+ */
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [options]\n", prog);
+  fprintf(stderr, "  -w LIST   worker threads (default 1,2,4)\n");
+  fprintf(stderr, "  -b LIST   bounded buffer sizes (default %d)\n", MAX);
+  fprintf(stderr, "  -n LIST   matrices per run (default %d)\n", LOOPS);
+  fprintf(stderr, "  -m LIST   matrix modes (default %d)\n", DEFAULT_MATRIX_MODE);
+  fprintf(stderr, "  -r N      measured runs per configuration (default 10)\n");
+  fprintf(stderr, "  -W N      warm-up runs per configuration (default 2)\n");
+  fprintf(stderr, "  -s SEED   random seed, reset before every run (default 1)\n");
+  fprintf(stderr, "  -t        run producers and consumers as cooperative tasks\n");
+  fprintf(stderr, "  -g SPEC   generate matrices following a workload specification\n");
+  fprintf(stderr, "  -d PCT    generate PCT%% nonzero elements, sparse matrices in CSR\n");
+  fprintf(stderr, "  -p        costliest multiplies first instead of FIFO order\n");
+  fprintf(stderr, "  -B N      multiply small pairs in batches of N of the same shape\n");
+  fprintf(stderr, "  -I N      embed matrices of up to N elements in buffer slots\n");
+  fprintf(stderr, "  -V PCT    check PCT%% of products with Freivalds' algorithm (report on stderr)\n");
+  fprintf(stderr, "  -M        account matrix memory and report it with peak RSS on stderr\n");
+  fprintf(stderr, "  -k        sum products from their operands instead of computing them (except -V samples)\n");
+  fprintf(stderr, "  -S        consumers share multiply tasks through work-stealing deques\n");
+  fprintf(stderr, "  -H        keep matrices and the buffer in a huge-page pool (-P: pre-faulted)\n");
+  fprintf(stderr, "  -a FILE   autotune over -w and -b (default: searched), inline slots and\n");
+  fprintf(stderr, "            stealing with -n matrices (default %d) and mode -m, and write a profile to FILE\n", TUNE_MATRICES);
+  fprintf(stderr, "  -f FMT    output format: csv or json (default csv)\n");
+  fprintf(stderr, "  -o FILE   write results to FILE instead of stdout\n");
+}
+
+/**
+ * @brief Parses a comma separated list of integers such as "1,2,4"
+ *
+ * @return 0 on success, -1 if the list is empty or too long
+ */
+static int parse_grid(char *list, Grid *g)
+{
+  g->n = 0;
+  for (char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+    if (g->n == MAX_GRID)
+      return -1;
+    g->v[g->n++] = atoi(tok);
+  }
+  return g->n > 0 ? 0 : -1;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Percentile of sorted samples with linear interpolation
+ */
+static double percentile(double *sorted, int n, double p)
+{
+  double rank = p / 100.0 * (n - 1);
+  int lo = (int)rank;
+  int hi = lo + 1 < n ? lo + 1 : lo;
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+/**
+ * @brief Writes a string as a JSON string literal, escaping quotes, backslashes and control characters
+ */
+static void json_string(FILE *out, const char *s)
+{
+  fputc('"', out);
+  for (; *s != '\0'; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+/**
+ * @brief Writes the host the results were measured on, as a JSON object
+ *
+ * Results are only comparable on the same host: its name, CPU model
+ * (from /proc/cpuinfo) and online core count.
+ */
+static void json_host(FILE *out)
+{
+  char name[256] = "unknown";
+  char cpu[256] = "unknown";
+  if (gethostname(name, sizeof(name)) != 0)
+    strcpy(name, "unknown");
+  name[sizeof(name) - 1] = '\0';
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  if (f != NULL) {
+    char line[512];
+    while (fgets(line, sizeof(line), f) != NULL) {
+      char *v = strchr(line, ':');
+      if (strncmp(line, "model name", 10) == 0 && v != NULL) {
+        v += strspn(v + 1, " \t") + 1;
+        v[strcspn(v, "\n")] = '\0';
+        snprintf(cpu, sizeof(cpu), "%s", v);
+        break;
+      }
+    }
+    fclose(f);
+  }
+  fprintf(out, "{\"name\": ");
+  json_string(out, name);
+  fprintf(out, ", \"cpu\": ");
+  json_string(out, cpu);
+  fprintf(out, ", \"cores\": %ld}", sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+/**
+ * @brief Index of the median run: the lower middle one by time when n is even
+ *
+ * Indices are sorted rather than times, so the run's other statistics
+ * (such as its multiplications) stay with its time.
+ */
+static int median_run(double *samples, int n)
+{
+  int order[n];
+  for (int i = 0; i < n; i++) {
+    int j = i;
+    for (; j > 0 && samples[order[j - 1]] > samples[i]; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+  return order[(n - 1) / 2];
+}
+
+/**
+ * @brief Runs a pipeline context once
+ *
+ * @param pipeline Context of the current configuration
+ * @param seed Seed reset before the run so every run sees the same workload
+ * @param totals Statistics of the run
+ * @return Run time in milliseconds, or a negative value if the sums do not match
+ */
+static double run_once(Pipeline *pipeline, unsigned seed, PipelineTotals *totals)
+{
+  srand(seed);
+  long long start = LatencyNow();
+  PipelineRun(pipeline, totals);
+  long long end = LatencyNow();
+  if (totals->prodsum != totals->conssum || totals->produced != totals->consumed)
+    return -1;
+  return (end - start) / 1e6;
+}
+
+int main (int argc, char * argv[])
+{
+  Grid workers = { 3, { 1, 2, 4 } };
+  Grid buffers = { 1, { MAX } };
+  Grid counts = { 1, { LOOPS } };
+  Grid modes = { 1, { DEFAULT_MATRIX_MODE } };
+  int reps = 10;
+  int warmups = 2;
+  unsigned seed = 1;
+  int format = FORMAT_CSV;
+  FILE *out = stdout;
+  char *tune_path = NULL;
+  int gridded[3] = { 0, 0, 0 };  // -w, -b and -n given
+
+  EXEC_MODE=DEFAULT_EXEC_MODE;
+  SCHED_WORKERS=coop_default_workers();
+  CHAIN_LENGTH=DEFAULT_CHAIN_LENGTH;
+  CACHE_SIZE=DEFAULT_CACHE_SIZE;
+  INPUT_PATH=NULL;
+  SHOW_RESULTS=0;
+  POOL_MODE=DEFAULT_POOL_MODE;
+  SPARSE_DENSITY=DEFAULT_SPARSE_DENSITY;
+  WORKLOAD_SPEC=NULL;
+  DURATION=DEFAULT_DURATION;
+  LATENCY=DEFAULT_LATENCY;
+  BUFFER_ORDER=DEFAULT_BUFFER_ORDER;
+  WORK_STEALING=DEFAULT_WORK_STEALING;
+  BATCH_SIZE=DEFAULT_BATCH_SIZE;
+  INLINE_MAX=DEFAULT_INLINE_MAX;
+  VERIFY_RATE=DEFAULT_VERIFY_RATE;
+  VERIFY_ROUNDS=DEFAULT_VERIFY_ROUNDS;
+  REPORT_INTERVAL=DEFAULT_REPORT_INTERVAL;
+  MEMORY_STATS=DEFAULT_MEMORY_STATS;
+  LAZY_PRODUCTS=DEFAULT_LAZY_PRODUCTS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "w:b:n:m:r:W:s:tpSMkB:I:V:HPd:g:f:o:a:")) != -1)
+  {
+    int rc = 0;
+    switch (opt)
+    {
+      case 'w': rc = parse_grid(optarg, &workers); gridded[0] = 1; break;
+      case 'b': rc = parse_grid(optarg, &buffers); gridded[1] = 1; break;
+      case 'n': rc = parse_grid(optarg, &counts); gridded[2] = 1; break;
+      case 'a': tune_path = optarg; break;
+      case 'm': rc = parse_grid(optarg, &modes); break;
+      case 'r': reps = atoi(optarg); break;
+      case 'W': warmups = atoi(optarg); break;
+      case 's': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 't': EXEC_MODE = EXEC_TASKS; break;
+      case 'p': BUFFER_ORDER = BUFFER_PRIORITY; break;
+      case 'S': WORK_STEALING = 1; break;
+      case 'M': MEMORY_STATS = 1; break;
+      case 'k': LAZY_PRODUCTS = 1; break;
+      case 'V':
+        VERIFY_RATE = atof(optarg) / 100;
+        if (VERIFY_RATE <= 0 || VERIFY_RATE > 1) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'I':
+        INLINE_MAX = atoi(optarg);
+        if (INLINE_MAX < 1) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'B':
+        BATCH_SIZE = atoi(optarg);
+        if (BATCH_SIZE < 1 || BATCH_SIZE > BATCH_MAX) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'H': POOL_MODE = POOL_MODE ? POOL_MODE : 1; break;
+      case 'P': POOL_MODE = 2; break;
+      case 'g':
+        WORKLOAD_SPEC = optarg;
+        rc = WorkloadInit(WORKLOAD_SPEC);
+        break;
+      case 'd':
+        SPARSE_DENSITY = atoi(optarg);
+        rc = SPARSE_DENSITY < 1 || SPARSE_DENSITY > 100 ? -1 : 0;
+        break;
+      case 'f':
+        if (strcmp(optarg, "csv") == 0)
+          format = FORMAT_CSV;
+        else if (strcmp(optarg, "json") == 0)
+          format = FORMAT_JSON;
+        else
+          rc = -1;
+        break;
+      case 'o':
+        out = fopen(optarg, "w");
+        if (out == NULL) {
+          perror(optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        rc = -1;
+    }
+    if (rc != 0 || reps < 1 || warmups < 0) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (tune_path != NULL) {
+    // Search with the first matrix mode, then save and print the winner
+    MATRIX_MODE = modes.v[0];
+    TuneSpace space;
+    memset(&space, 0, sizeof(space));
+    for (int i = 0; gridded[0] && i < workers.n && i < TUNE_MAX_VALUES; i++)
+      space.workers.v[space.workers.n++] = workers.v[i];
+    for (int i = 0; gridded[1] && i < buffers.n && i < TUNE_MAX_VALUES; i++)
+      space.buffers.v[space.buffers.n++] = buffers.v[i];
+    TuneConfig best;
+    if (TuneSearch(&space, gridded[2] ? counts.v[0] : TUNE_MATRICES, seed, stderr, &best) != 0) {
+      fprintf(stderr, "pcbench: no configuration completed a run\n");
+      return EXIT_FAILURE;
+    }
+    if (TuneSave(tune_path, &best) != 0)
+      return EXIT_FAILURE;
+    fprintf(out, "workers=%d buffer=%d batch=%d inline=%d steal=%d matrices_per_s=%.0f\n",
+            best.workers, best.buffer_size, best.batch_size, best.inline_max, best.work_stealing, best.score);
+    if (out != stdout)
+      fclose(out);
+    return EXIT_SUCCESS;
+  }
+
+  if (format == FORMAT_CSV)
+    fprintf(out, "exec,workers,buffer,matrices,mode,runs,mean_ms,min_ms,p50_ms,p90_ms,p99_ms,max_ms,matrices_per_s,mults_per_s\n");
+  else {
+    fprintf(out, "{\n  \"exec\": \"%s\",\n  \"seed\": %u,\n  \"host\": ", EXEC_MODE == EXEC_TASKS ? "tasks" : "threads", seed);
+    json_host(out);
+    fprintf(out, ",\n");
+    if (WORKLOAD_SPEC != NULL) {
+      fprintf(out, "  \"workload\": ");
+      json_string(out, WORKLOAD_SPEC);
+      fprintf(out, ",\n");
+    }
+    fprintf(out, "  \"results\": [");
+  }
+
+  int first = 1;
+  double samples[reps];
+  int mults[reps];
+  if (VERIFY_RATE > 0)
+    VerifyInit(VERIFY_RATE, VERIFY_ROUNDS);
+
+  for (int wi = 0; wi < workers.n; wi++)
+  for (int bi = 0; bi < buffers.n; bi++)
+  for (int ni = 0; ni < counts.n; ni++)
+  for (int mi = 0; mi < modes.n; mi++)
+  {
+    numw = workers.v[wi];
+    BOUNDED_BUFFER_SIZE = buffers.v[bi];
+    NUMBER_OF_MATRICES = counts.v[ni];
+    MATRIX_MODE = modes.v[mi];
+    AGING = BOUNDED_BUFFER_SIZE;
+    PipelineConfig cfg = { numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES, 0, 0, NULL, NULL, NULL };
+    PipelineTotals totals;
+    if (PipelinePoolInit(&cfg) != 0)
+      fprintf(stderr, "pcbench: matrix pool unavailable, using the heap\n");
+    Pipeline *pipeline = PipelineCreate(&cfg);
+    if (pipeline == NULL) {
+      fprintf(stderr, "pcbench: invalid configuration (workers=%d buffer=%d matrices=%d)\n",
+              numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES);
+      return EXIT_FAILURE;
+    }
+
+    // Warm caches, the allocator and the thread stacks, then measure
+    for (int r = 0; r < warmups + reps; r++) {
+      double ms = run_once(pipeline, seed, &totals);
+      if (ms < 0) {
+        fprintf(stderr, "pcbench: produced and consumed totals differ (workers=%d buffer=%d matrices=%d mode=%d)\n",
+                numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES, MATRIX_MODE);
+        return EXIT_FAILURE;
+      }
+      if (r >= warmups) {
+        samples[r - warmups] = ms;
+        mults[r - warmups] = totals.multiplied;
+      }
+    }
+
+    PipelineDestroy(pipeline);
+    PoolDestroy();
+
+    // Throughput is reported at the median run
+    double sorted[reps];
+    memcpy(sorted, samples, sizeof(sorted));
+    qsort(sorted, reps, sizeof(double), cmp_double);
+    Result res;
+    res.mean = 0;
+    for (int r = 0; r < reps; r++)
+      res.mean += samples[r] / reps;
+    res.min = sorted[0];
+    res.max = sorted[reps - 1];
+    res.p50 = percentile(sorted, reps, 50);
+    res.p90 = percentile(sorted, reps, 90);
+    res.p99 = percentile(sorted, reps, 99);
+    int median = median_run(samples, reps);
+    res.multiplied = mults[median];
+    res.matrices_per_s = NUMBER_OF_MATRICES / (samples[median] / 1000.0);
+    res.mults_per_s = res.multiplied / (samples[median] / 1000.0);
+
+    if (format == FORMAT_CSV) {
+      fprintf(out, "%s,%d,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f\n",
+              EXEC_MODE == EXEC_TASKS ? "tasks" : "threads",
+              numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES, MATRIX_MODE, reps,
+              res.mean, res.min, res.p50, res.p90, res.p99, res.max,
+              res.matrices_per_s, res.mults_per_s);
+    }
+    else {
+      fprintf(out, "%s\n    {\"workers\": %d, \"buffer\": %d, \"matrices\": %d, \"mode\": %d, \"runs\": %d,"
+              " \"mean_ms\": %.3f, \"min_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f,"
+              " \"matrices_per_s\": %.0f, \"mults_per_s\": %.0f, \"samples_ms\": [",
+              first ? "" : ",", numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES, MATRIX_MODE, reps,
+              res.mean, res.min, res.p50, res.p90, res.p99, res.max,
+              res.matrices_per_s, res.mults_per_s);
+      for (int r = 0; r < reps; r++)
+        fprintf(out, "%s%.3f", r ? ", " : "", samples[r]);
+      fprintf(out, "]}");
+    }
+    fflush(out);
+    first = 0;
+  }
+
+  if (format == FORMAT_JSON)
+    fprintf(out, "\n  ]\n}\n");
+  if (VERIFY_RATE > 0)
+    VerifyReport(stderr, 0);
+  if (MEMORY_STATS)
+    MemoryReport(stderr, 0);
+  if (out != stdout)
+    fclose(out);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*
+ *  pccorpus module
+ *  Command line tool to write and inspect matrix corpora
+ *
+ *  pcCorpus write FILE COUNT [MATRIX_MODE [SEED]]
+ *    Dumps COUNT matrices from GenMatrixRandom() into a corpus. The same
+ *    seed always produces the same corpus, so benchmark inputs can be
+ *    generated once and replayed with: pcMatrix -F corpus -i FILE
+ *  pcCorpus info FILE
+ *    Prints the header and a summary of the shapes in the corpus.
+ *  pcCorpus get FILE INDEX [N]
+ *    Prints N matrices (default 1) starting at INDEX, as DisplayMatrix does.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+/**
+ * @file pccorpus.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "corpus.h"
+#include "pcmatrix.h"
+
+/**
+ * @brief Prints command line usage
+ *
+ * @param prog Program name (argv[0])
+ */
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s write FILE COUNT [matrix_mode [seed]]\n", prog);
+  fprintf(stderr, "       %s info FILE\n", prog);
+  fprintf(stderr, "       %s get FILE INDEX [N]\n", prog);
+}
+
+/**
+ * @brief Generates count matrices and writes them to a new corpus
+ */
+static int write_corpus(char *path, long count, unsigned seed)
+{
+  CorpusWriter *w = CorpusCreate(path, count);
+  if (w == NULL)
+    return EXIT_FAILURE;
+  srand(seed);
+  for (long i = 0; i < count; i++) {
+    Matrix *mat = GenMatrixRandom();
+    int rc = CorpusAppend(w, mat);
+    FreeMatrix(mat);
+    if (rc != 0) {
+      fprintf(stderr, "%s: write failed\n", path);
+      CorpusFinish(w);
+      return EXIT_FAILURE;
+    }
+  }
+  if (CorpusFinish(w) != 0) {
+    fprintf(stderr, "%s: write failed\n", path);
+    return EXIT_FAILURE;
+  }
+  printf("Wrote %ld matrices in mode %d (seed %u) to %s\n", count, MATRIX_MODE, seed, path);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints the header and shape summary of a corpus
+ */
+static int info_corpus(char *path)
+{
+  Corpus *c = CorpusOpen(path);
+  if (c == NULL)
+    return EXIT_FAILURE;
+  long count = CorpusCount(c);
+  long long elements = 0;
+  uint32_t maxr = 0, maxc = 0;
+  for (long i = 0; i < count; i++) {
+    elements += (long long)c->index[i].rows * c->index[i].cols;
+    if (c->index[i].rows > maxr)
+      maxr = c->index[i].rows;
+    if (c->index[i].cols > maxc)
+      maxc = c->index[i].cols;
+  }
+  printf("%s: version=%u matrices=%ld elements=%lld bytes=%zu align=%u\n",
+         path, c->header->version, count, elements, c->length, c->header->align);
+  if (count > 0)
+    printf("largest rows=%u largest cols=%u\n", maxr, maxc);
+  CorpusClose(c);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Prints n matrices of a corpus starting at first
+ */
+static int get_corpus(char *path, long first, long n)
+{
+  Corpus *c = CorpusOpen(path);
+  if (c == NULL)
+    return EXIT_FAILURE;
+  int rc = EXIT_SUCCESS;
+  for (long i = first; i < first + n; i++) {
+    if (i < 0 || i >= CorpusCount(c)) {
+      fprintf(stderr, "%s: no matrix %ld (corpus holds %ld)\n", path, i, CorpusCount(c));
+      rc = EXIT_FAILURE;
+      break;
+    }
+    Matrix *mat = CorpusMatrix(c, i);
+    if (mat == NULL) {
+      rc = EXIT_FAILURE;
+      break;
+    }
+    DisplayMatrix(mat, stdout);
+    printf("\n");
+    FreeMatrix(mat);
+  }
+  CorpusClose(c);
+  return rc;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc >= 4 && strcmp(argv[1], "write") == 0)
+  {
+    MATRIX_MODE = argc >= 5 ? atoi(argv[4]) : DEFAULT_MATRIX_MODE;
+    unsigned seed = argc >= 6 ? (unsigned)strtoul(argv[5], NULL, 10) : 1;
+    return write_corpus(argv[2], atol(argv[3]), seed);
+  }
+  if (argc == 3 && strcmp(argv[1], "info") == 0)
+    return info_corpus(argv[2]);
+  if (argc >= 4 && strcmp(argv[1], "get") == 0)
+    return get_corpus(argv[2], atol(argv[3]), argc >= 5 ? atol(argv[4]) : 1);
+  usage(argv[0]);
+  return EXIT_FAILURE;
+}
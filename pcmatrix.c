@@ -16,8 +16,13 @@
  *  - the total number of matrices produced (matrixtotal from each producer thread)
  *  - the total number of matrices consumed (matrixtotal from each consumer thread)
  *  - the sum of all elements of all matrices produced and consumed (sumtotal from each producer and consumer thread)
+ *  - the sum of all elements of all products (productsum from each consumer thread)
  *  
  *  Then, these values from each thread are aggregated in main thread for output
+ *  (see PipelineRun() in pipeline.c)
+ *
+ *  The engine itself is the pipeline library (libpcmatrix.a); this program
+ *  parses the command line into its settings and one pipeline context.
  *
  *  Correct programs will produce and consume the same number of matrices, and
  *  report the same sum for all matrix elements produced and consumed.
@@ -41,14 +46,249 @@
 #include <pthread.h>
 #include <assert.h>
 #include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
 #include "matrix.h"
 #include "counter.h"
+#include "coop.h"
+#include "chain.h"
+#include "cache.h"
+#include "input.h"
+#include "instrument.h"
+#include "trace.h"
+#include "pool.h"
+#include "workload.h"
+#include "latency.h"
+#include "steal.h"
+#include "batch.h"
+#include "verify.h"
+#include "tune.h"
+#include "memory.h"
 #include "prodcons.h"
+#include "pipeline.h"
 #include "pcmatrix.h"
 
+/**
+ * @brief Prints command line usage
+ *
+ * @param prog Program name (argv[0])
+ */
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [options] [worker_threads [bounded_buffer_size [matricies [matrix_mode]]]]\n", prog);
+  fprintf(stderr, "  -t        run producers and consumers as cooperative tasks\n");
+  fprintf(stderr, "  -j N      scheduler threads for -t (default: one per core)\n");
+  fprintf(stderr, "  -C N      multiply chains of up to N compatible matrices (2-%d)\n", MAX_CHAIN);
+  fprintf(stderr, "  -q        do not print multiplications, only the summary\n");
+  fprintf(stderr, "  -k        with -q, sum products from their operands instead of computing them,\n");
+  fprintf(stderr, "            except those -V samples\n");
+  fprintf(stderr, "  -c N      cache up to N products of repeated operand pairs\n");
+  fprintf(stderr, "  -i FILE   read matrices from FILE (- for stdin) instead of generating them\n");
+  fprintf(stderr, "  -F FMT    input format for -i: text (DisplayMatrix output), binary or corpus\n");
+  fprintf(stderr, "  -T FILE   write a Chrome trace (chrome://tracing, ui.perfetto.dev) of thread activity to FILE\n");
+  fprintf(stderr, "  -g SPEC   generate matrices following a workload specification (see workload.h)\n");
+  fprintf(stderr, "  -d PCT    generate PCT%% nonzero elements and store sparse matrices in CSR\n");
+  fprintf(stderr, "  -D SECS   stop producing after SECS seconds (or at the matrix count, if given)\n");
+  fprintf(stderr, "  -r SECS   report rates every SECS seconds (default 1 with -D)\n");
+  fprintf(stderr, "  -L        report queueing, pair and end-to-end latency percentiles\n");
+  fprintf(stderr, "  -p        hand out the costliest multiplies first instead of FIFO order\n");
+  fprintf(stderr, "  -A N      with -p, a matrix waiting N more puts counts as twice as costly\n");
+  fprintf(stderr, "            (default: the buffer size); -p and -L report makespan and idle time\n");
+  fprintf(stderr, "  -S        multiply pairs as tasks that idle consumers steal, splitting large products\n");
+  fprintf(stderr, "  -B N      multiply pairs of up to %dx%d matrices in batches of N of the same shape\n",
+          BATCH_MAX_DIM, BATCH_MAX_DIM);
+  fprintf(stderr, "  -I N      embed matrices of up to N elements in buffer slots by value (FIFO order only)\n");
+  fprintf(stderr, "  -V PCT    check PCT%% of products with Freivalds' algorithm and report failures\n");
+  fprintf(stderr, "  -R N      rounds per check for -V (default %d, a wrong product passes with odds 2^-N)\n",
+          DEFAULT_VERIFY_ROUNDS);
+  fprintf(stderr, "  -M        account matrix memory by place and report it with peak RSS (also with -r)\n");
+  fprintf(stderr, "  -U FILE   load a tuned profile written by pcBench -a; explicit options and arguments win\n");
+  fprintf(stderr, "  -H        keep matrices and the buffer in a preallocated huge-page pool\n");
+  fprintf(stderr, "  -P        as -H, and pre-fault the pool at startup\n");
+}
+
 int main (int argc, char * argv[])
 {
-  // Process command line arguments
+  // Process command line options
+  EXEC_MODE=DEFAULT_EXEC_MODE;
+  SCHED_WORKERS=0;
+  CHAIN_LENGTH=DEFAULT_CHAIN_LENGTH;
+  CACHE_SIZE=DEFAULT_CACHE_SIZE;
+  INPUT_PATH=NULL;
+  INPUT_FORMAT=INPUT_TEXT;
+  SHOW_RESULTS=DEFAULT_SHOW_RESULTS;
+  TRACE_PATH=NULL;
+  POOL_MODE=DEFAULT_POOL_MODE;
+  SPARSE_DENSITY=DEFAULT_SPARSE_DENSITY;
+  WORKLOAD_SPEC=NULL;
+  DURATION=DEFAULT_DURATION;
+  LATENCY=DEFAULT_LATENCY;
+  BUFFER_ORDER=DEFAULT_BUFFER_ORDER;
+  AGING=0;
+  WORK_STEALING=DEFAULT_WORK_STEALING;
+  BATCH_SIZE=DEFAULT_BATCH_SIZE;
+  INLINE_MAX=DEFAULT_INLINE_MAX;
+  VERIFY_RATE=DEFAULT_VERIFY_RATE;
+  VERIFY_ROUNDS=DEFAULT_VERIFY_ROUNDS;
+  REPORT_INTERVAL=DEFAULT_REPORT_INTERVAL;
+  TUNE_PATH=NULL;
+  MEMORY_STATS=DEFAULT_MEMORY_STATS;
+  LAZY_PRODUCTS=DEFAULT_LAZY_PRODUCTS;
+  int opt;
+  while ((opt = getopt(argc, argv, "tj:C:c:i:F:qT:HPd:g:D:r:LpA:SB:I:V:R:U:Mk")) != -1)
+  {
+    switch (opt)
+    {
+      case 't':
+        EXEC_MODE=EXEC_TASKS;
+        break;
+      case 'j':
+        SCHED_WORKERS=atoi(optarg);
+        break;
+      case 'C':
+        CHAIN_LENGTH=atoi(optarg);
+        if (CHAIN_LENGTH<2 || CHAIN_LENGTH>MAX_CHAIN)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'q':
+        SHOW_RESULTS=0;
+        break;
+      case 'c':
+        CACHE_SIZE=atoi(optarg);
+        break;
+      case 'i':
+        INPUT_PATH=optarg;
+        break;
+      case 'V':
+        VERIFY_RATE=atof(optarg)/100;
+        if (VERIFY_RATE<=0 || VERIFY_RATE>1)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'R':
+        VERIFY_ROUNDS=atoi(optarg);
+        if (VERIFY_ROUNDS<1)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'I':
+        INLINE_MAX=atoi(optarg);
+        if (INLINE_MAX<1)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'B':
+        BATCH_SIZE=atoi(optarg);
+        if (BATCH_SIZE<1 || BATCH_SIZE>BATCH_MAX)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'S':
+        WORK_STEALING=1;
+        break;
+      case 'p':
+        BUFFER_ORDER=BUFFER_PRIORITY;
+        break;
+      case 'A':
+        AGING=atoi(optarg);
+        if (AGING<1)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'L':
+        LATENCY=1;
+        break;
+      case 'M':
+        MEMORY_STATS=1;
+        break;
+      case 'k':
+        LAZY_PRODUCTS=1;
+        break;
+      case 'D':
+        DURATION=atof(optarg);
+        if (DURATION<=0)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'r':
+        REPORT_INTERVAL=atof(optarg);
+        if (REPORT_INTERVAL<=0)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'g':
+        WORKLOAD_SPEC=optarg;
+        if (WorkloadInit(WORKLOAD_SPEC) != 0)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'd':
+        SPARSE_DENSITY=atoi(optarg);
+        if (SPARSE_DENSITY<1 || SPARSE_DENSITY>100)
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'H':
+        if (POOL_MODE==0)
+          POOL_MODE=1;
+        break;
+      case 'P':
+        POOL_MODE=2;
+        break;
+      case 'T':
+        TRACE_PATH=optarg;
+        break;
+      case 'U':
+        TUNE_PATH=optarg;
+        break;
+      case 'F':
+        if (strcmp(optarg, "text") == 0)
+          INPUT_FORMAT=INPUT_TEXT;
+        else if (strcmp(optarg, "binary") == 0)
+          INPUT_FORMAT=INPUT_BINARY;
+        else if (strcmp(optarg, "corpus") == 0)
+          INPUT_FORMAT=INPUT_CORPUS;
+        else
+        {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (SCHED_WORKERS<=0)
+    SCHED_WORKERS=coop_default_workers();
+  if (DURATION>0 && REPORT_INTERVAL<=0)
+    REPORT_INTERVAL=1;
+
+  // Process positional arguments
+  argc -= optind - 1;
+  argv += optind - 1;
   if (argc==1)
   {
     numw=NUMWORK;
@@ -90,64 +330,118 @@ int main (int argc, char * argv[])
     printf("USING: worker_threads=%d bounded_buffer_size=%d matricies=%d matrix_mode=%d\n",numw,BOUNDED_BUFFER_SIZE,NUMBER_OF_MATRICES,MATRIX_MODE);
   }
 
+  // A tuned profile supplies what the command line left at its defaults
+  if (TUNE_PATH != NULL)
+  {
+    TuneConfig tuned = { numw, BOUNDED_BUFFER_SIZE, BATCH_SIZE, INLINE_MAX, WORK_STEALING, 0 };
+    if (TuneLoad(TUNE_PATH, &tuned) != 0)
+      return EXIT_FAILURE;
+    if (argc < 2)
+      numw=tuned.workers;
+    if (argc < 3)
+      BOUNDED_BUFFER_SIZE=tuned.buffer_size;
+    if (BATCH_SIZE == DEFAULT_BATCH_SIZE)
+      BATCH_SIZE=tuned.batch_size;
+    if (INLINE_MAX == DEFAULT_INLINE_MAX)
+      INLINE_MAX=tuned.inline_max;
+    if (WORK_STEALING == DEFAULT_WORK_STEALING)
+      WORK_STEALING=tuned.work_stealing;
+    printf("TUNED (%s): worker_threads=%d bounded_buffer_size=%d batch=%d inline=%d steal=%d\n",TUNE_PATH,
+           numw,BOUNDED_BUFFER_SIZE,BATCH_SIZE,INLINE_MAX,WORK_STEALING);
+  }
+
+  // Replay the whole input unless a matrix count was given
+  if (INPUT_PATH != NULL)
+  {
+    if (argc < 4)
+      NUMBER_OF_MATRICES=INT_MAX;
+    if (OpenInput(INPUT_PATH, INPUT_FORMAT, numw) != 0)
+      return EXIT_FAILURE;
+  }
+
+  if (AGING<=0)
+    AGING=BOUNDED_BUFFER_SIZE;
+
+  // A timed run produces until its deadline unless a matrix count was given
+  if (DURATION > 0 && argc < 4)
+    NUMBER_OF_MATRICES=INT_MAX;
+
   time_t t;
   // Seed the random number generator with the system time
   srand((unsigned) time(&t));
 
 
-  printf("Producing %d matrices in mode %d.\n",NUMBER_OF_MATRICES,MATRIX_MODE);
+  if (INPUT_PATH != NULL)
+    printf("Producing matrices from %s.\n",INPUT_PATH);
+  else if (NUMBER_OF_MATRICES == INT_MAX)
+    printf("Producing matrices in mode %d.\n",MATRIX_MODE);
+  else
+    printf("Producing %d matrices in mode %d.\n",NUMBER_OF_MATRICES,MATRIX_MODE);
+  if (DURATION > 0)
+    printf("For %.1f second(s), then draining the buffer.\n",DURATION);
+  if (WORKLOAD_SPEC != NULL && INPUT_PATH == NULL)
+    printf("Following workload %s\n",WORKLOAD_SPEC);
   printf("Using a shared buffer of size=%d\n", BOUNDED_BUFFER_SIZE);
   printf("With %d producer and consumer thread(s).\n",numw);
   printf("\n");
-  // Allocate memory for the bounded buffer
-  bigmatrix = (Matrix **) malloc(sizeof(Matrix *) * BOUNDED_BUFFER_SIZE);
-  
-  // Declare arrays to hold producer and consumer thread IDs
-  pthread_t pr[numw];
-  pthread_t co[numw];
-
-  // Create producer and consumer threads
-  for (int i = 0; i < numw; i++) {
-    if(pthread_create(&pr[i], NULL, prod_worker, NULL) != 0) {
-      perror("Producer Thread");
-    }
-    if (pthread_create(&co[i], NULL, cons_worker, NULL) != 0) {
-      perror("Consumer Thread");
-    }
-  }
-  
-  // Initialize variables to track aggregate statistics
-  int prs = 0;     // total #matrices produced
-  int cos = 0;     // total #matrices consumed
-  int prodtot = 0; // total sum of elements for matrices produced
-  int constot = 0; // total sum of elements for matrices consumed
-  int consmul = 0; // total # multiplications
-
-  // Pointer to hold returned statistics from threads
-  ProdConsStats *stats;
-  
-  // Join all threads and collect their statistics
-  for (int i = 0; i < numw; i++) { 
-
-    // Join producer threads and collect their stats
-    pthread_join(pr[i], (void**)&stats);
-    prodtot += stats->sumtotal;
-    prs += stats->matrixtotal;
-    free(stats);
-    
-    // Join consumer threads and collect their stats
-    pthread_join(co[i], (void**)&stats);
-    constot += stats->sumtotal;
-    cos += stats->matrixtotal;
-    consmul += stats->multtotal;
-    free(stats);
+  if (CACHE_SIZE > 0)
+    CacheInit(CACHE_SIZE);
+  if (VERIFY_RATE > 0)
+    VerifyInit(VERIFY_RATE, VERIFY_ROUNDS);
+  if (EXEC_MODE == EXEC_TASKS)
+    printf("Scheduling tasks on %d worker thread(s).\n\n", SCHED_WORKERS);
+
+  // Run the producers and consumers, then report their aggregate statistics
+  PipelineConfig cfg = { numw, BOUNDED_BUFFER_SIZE, NUMBER_OF_MATRICES, DURATION, REPORT_INTERVAL, NULL, NULL, NULL };
+  PipelineTotals totals;
+  if (PipelinePoolInit(&cfg) != 0)
+    fprintf(stderr, "Matrix pool unavailable, using the heap\n");
+  Pipeline *pipeline = PipelineCreate(&cfg);
+  if (pipeline == NULL)
+  {
+    fprintf(stderr, "Invalid pipeline configuration\n");
+    return EXIT_FAILURE;
   }
-  
-  // Clean up allocated memory for the buffer
-  free(bigmatrix);
+  if (TRACE_PATH != NULL)
+    TraceStart();
+  PipelineRun(pipeline, &totals);
+  PipelineDestroy(pipeline);
+  if (TRACE_PATH != NULL && TraceWrite(TRACE_PATH) != 0)
+    fprintf(stderr, "Could not write trace to %s\n", TRACE_PATH);
 
-  printf("Sum of Matrix elements --> Produced=%d = Consumed=%d\n",prodtot,constot);
-  printf("Matrices produced=%d consumed=%d multiplied=%d\n",prs,cos,consmul);
+  if (INPUT_PATH != NULL)
+    CloseInput();
+
+  printf("Sum of Matrix elements --> Produced=%d = Consumed=%d\n",totals.prodsum,totals.conssum);
+  printf("Matrices produced=%d consumed=%d multiplied=%d\n",totals.produced,totals.consumed,totals.multiplied);
+  printf("Sum of product elements --> %d%s\n",totals.productsum,
+         LAZY_PRODUCTS && !SHOW_RESULTS ? " (summed from operands)" : "");
+  if (BUFFER_ORDER == BUFFER_PRIORITY || LATENCY)
+    printf("Makespan %.3f s --> consumer idle %.3f s (%.1f%% of consumer time)\n",totals.seconds,
+           totals.idle,100.0*totals.idle/(numw*totals.seconds));
+  if (REPORT_INTERVAL > 0)
+    printf("Sustained rates over %.2f s --> produced=%.0f/s consumed=%.0f/s multiplied=%.0f/s\n",totals.seconds,
+           totals.produced/totals.seconds,totals.consumed/totals.seconds,totals.multiplied/totals.seconds);
+  if (CHAIN_LENGTH > 0)
+    printf("Chain scalar multiplications --> optimal=%lld left-to-right=%lld\n",totals.chaincost,totals.naivecost);
+  // Before the cache releases the products it holds
+  if (MEMORY_STATS)
+    MemoryReport(stdout, totals.seconds);
+  if (CACHE_SIZE > 0)
+  {
+    CacheReport(stdout);
+    CacheDestroy();
+  }
+  if (WORK_STEALING && CHAIN_LENGTH == 0 && BATCH_SIZE == 0)
+    printf("Work stealing --> tasks=%ld stolen=%ld (%.1f%%)\n",totals.tasks,totals.stolen,
+           totals.tasks > 0 ? 100.0*totals.stolen/totals.tasks : 0.0);
+  if (VERIFY_RATE > 0)
+    VerifyReport(stdout, numw*totals.seconds);
+  if (LATENCY)
+    LatencyReport(stdout);
+  PoolReport(stdout);
+  PoolDestroy();
+  InstrReport(stdout);
 
   return EXIT_SUCCESS;
 }
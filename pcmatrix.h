@@ -13,6 +13,12 @@ int numw;
 // Constant for enabling and disabling DEBUG output
 #define OUTPUT 0
 
+// Constant for compiling in hot-path instrumentation (see instrument.h)
+// Override with -DINSTRUMENT=1, as the pcMatrix-stats target does
+#ifndef INSTRUMENT
+#define INSTRUMENT 0
+#endif
+
 // Size of the buffer ARRAY  (see ch. 30, section 2, producer/consumer)
 #define MAX 200
 int BOUNDED_BUFFER_SIZE;
@@ -26,3 +32,148 @@ int NUMBER_OF_MATRICES;
 // mode 1-n - Specifies a fixed number of rows and cols with matrix elements of 1
 #define DEFAULT_MATRIX_MODE 0
 int MATRIX_MODE;
+
+// EXECUTION MODE FLAG
+// EXEC_THREADS - one pthread per producer and consumer
+// EXEC_TASKS   - producers and consumers run as cooperative tasks on a
+//                fixed pool of SCHED_WORKERS threads (0 = one per core)
+#define EXEC_THREADS 0
+#define EXEC_TASKS 1
+#define DEFAULT_EXEC_MODE EXEC_THREADS
+int EXEC_MODE;
+int SCHED_WORKERS;
+
+// CHAIN MODE
+// 0 - consumers multiply pairs of matrices
+// 2-MAX_CHAIN - consumers gather chains of up to CHAIN_LENGTH compatible
+//               matrices and multiply them in the optimal order
+#define DEFAULT_CHAIN_LENGTH 0
+int CHAIN_LENGTH;
+
+// PRODUCT CACHE
+// 0 - every product is computed
+// n - consumers look products up in a cache of n entries before multiplying
+#define DEFAULT_CACHE_SIZE 0
+int CACHE_SIZE;
+
+// INPUT MODE
+// NULL - producers generate matrices with GenMatrixRandom()
+// path - producers read matrices from the file ("-" for stdin) in INPUT_FORMAT
+char * INPUT_PATH;
+int INPUT_FORMAT;
+
+// RESULT OUTPUT FLAG
+// 1 - consumers print every multiplication and its product
+// 0 - consumers only collect statistics (used by benchmarks)
+#define DEFAULT_SHOW_RESULTS 1
+int SHOW_RESULTS;
+
+// TIMELINE TRACE
+// NULL - no trace is recorded
+// path - every thread's activity is written to the file as a Chrome trace
+char * TRACE_PATH;
+
+// MATRIX POOL
+// 0 - matrices and the bounded buffer are malloc'ed
+// 1 - they come from a preallocated huge-page pool (see pool.c)
+// 2 - as 1, with every page of the pool faulted in at startup
+#define DEFAULT_POOL_MODE 0
+int POOL_MODE;
+
+// SPARSE MODE
+// 0     - matrices are always stored densely
+// 1-100 - generated elements are nonzero with this percent probability, and
+//         generated, input and product matrices are stored in CSR when their
+//         measured density is low enough (see sparse.h)
+#define DEFAULT_SPARSE_DENSITY 0
+int SPARSE_DENSITY;
+
+// WORKLOAD
+// NULL - matrices are generated according to MATRIX_MODE
+// spec - matrices follow the shape and value mix of the workload specification
+//        (see workload.h)
+char * WORKLOAD_SPEC;
+
+// DURATION MODE
+// 0 - run until NUMBER_OF_MATRICES matrices are produced
+// s - stop producing after s seconds (or at NUMBER_OF_MATRICES, if sooner),
+//     then drain the buffer
+#define DEFAULT_DURATION 0
+double DURATION;
+
+// PROGRESS REPORTS
+// 0 - no reports while running
+// s - print produced, consumed and multiplied rates every s seconds
+#define DEFAULT_REPORT_INTERVAL 0
+double REPORT_INTERVAL;
+
+// LATENCY TRACKING
+// 0 - matrices are not timestamped
+// 1 - queueing, pair and end-to-end latencies go into HDR histograms (see latency.h)
+#define DEFAULT_LATENCY 0
+int LATENCY;
+
+// BUFFER ORDER
+// BUFFER_FIFO     - matrices are consumed in the order they were produced
+// BUFFER_PRIORITY - the largest estimated multiply first, aged so that a
+//                   matrix waiting AGING more puts counts as twice as costly
+#define BUFFER_FIFO 0
+#define BUFFER_PRIORITY 1
+#define DEFAULT_BUFFER_ORDER BUFFER_FIFO
+int BUFFER_ORDER;
+int AGING;
+
+// WORK STEALING
+// 0 - a consumer multiplies each pair it finds, holding the buffer lock
+// 1 - pairs become multiply tasks on the finding consumer's deque, large
+//     products split into row blocks, and idle consumers steal tasks (see steal.h)
+#define DEFAULT_WORK_STEALING 0
+int WORK_STEALING;
+
+// BATCHED MULTIPLY
+// 0 - pairs are multiplied one at a time
+// n - consumers gather small dense pairs into batches of n pairs of the same
+//     shape, multiplied together in structure-of-arrays layout (see batch.h).
+//     Each multiply is faster (see pcMicroBench), but throughput and latency
+//     end to end are unchanged: for such small pairs the buffer, not the
+//     multiply, bounds the pipeline. The autotuner does not try it by default.
+#define DEFAULT_BATCH_SIZE 0
+int BATCH_SIZE;
+
+// INLINE BUFFER SLOTS
+// 0 - the bounded buffer holds pointers to heap-allocated matrices
+// n - FIFO buffer slots embed dense matrices of up to n elements by value,
+//     and such matrices are allocated in one block recycled per thread
+//     (MATRIX_SMALL); larger matrices are still held by pointer
+#define DEFAULT_INLINE_MAX 0
+int INLINE_MAX;
+
+// PRODUCT VERIFICATION
+// 0     - products are trusted
+// 0 - 1 - this fraction of products is checked with VERIFY_ROUNDS rounds of
+//         Freivalds' algorithm (see verify.h); failures are counted and reported
+#define DEFAULT_VERIFY_RATE 0
+double VERIFY_RATE;
+int VERIFY_ROUNDS;
+
+// LAZY PRODUCTS
+// 0 - consumers compute every product
+// 1 - when nothing reads a product's elements (SHOW_RESULTS is off, there is
+//     no result callback and verification did not sample it), consumers
+//     only compute its element sum from the operands (see SumProduct())
+#define DEFAULT_LAZY_PRODUCTS 0
+int LAZY_PRODUCTS;
+
+// TUNED PROFILE
+// NULL - the knobs come from the command line and their defaults
+// path - a profile written by pcBench -a (see tune.h) supplies the worker
+//        count, buffer size, BATCH_SIZE, INLINE_MAX and WORK_STEALING
+//        wherever the command line leaves them at their defaults
+char * TUNE_PATH;
+
+// MEMORY ACCOUNTING
+// 0 - matrix allocations are not counted
+// 1 - live matrices and bytes are tracked by place (producers, buffer,
+//     consumers), with allocation rates and the process RSS (see memory.h)
+#define DEFAULT_MEMORY_STATS 0
+int MEMORY_STATS;
@@ -0,0 +1,343 @@
+/*
+ *  pcmicrobench module
+ *  Microbenchmarks for the matrix kernels in matrix.c
+ *
+ *  Times AllocMatrix/FreeMatrix, GenMatrix, SumMatrix, MatrixMultiply,
+ *  batched multiplies (per pair, see batch.h) and DisplayMatrix over a
+ *  sweep of shapes, from the 1-4 shapes of matrix
+ *  mode 0 up to large squares. Each kernel is repeated until it has run
+ *  for at least the minimum time, and reported as ns/op, GFLOP/s (for
+ *  the arithmetic kernels), bytes touched per op and, where the kernel
+ *  allows perf_event_open(), hardware cache misses per op.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+/**
+ * @file pcmicrobench.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "matrix.h"
+#include "pcmatrix.h"
+#include "batch.h"
+#include "latency.h"
+
+// Kernels under test
+#define K_ALLOC 0
+#define K_GEN 1
+#define K_SUM 2
+#define K_MULTIPLY 3
+#define K_DISPLAY 4
+#define K_BATCH 5
+#define NUM_KERNELS 6
+
+static const char *kernel_names[NUM_KERNELS] = { "alloc+free", "gen", "sum", "multiply", "display", "batch" };
+
+// Pairs per batch of the batch kernel
+#define BENCH_BATCH 256
+
+// Largest square size -M accepts
+#define MAX_SWEEP 4096
+
+/**
+ * @brief Measurement of one kernel on one shape
+ */
+typedef struct measurement {
+  long iters;
+  double ns_per_op;
+  double gflops;        /**< 0 when the kernel does no arithmetic */
+  double bytes_per_op;
+  double misses_per_op; /**< negative when cache misses could not be counted */
+} Measurement;
+
+/** Stream DisplayMatrix writes to, and the cache-miss counter (-1 if unavailable) */
+static FILE *devnull = NULL;
+static int perf_fd = -1;
+/** Batches the batch kernel adds its pairs to */
+static Batch *batch = NULL;
+
+/**
+ * @brief Prints command line usage
+ *
+ * @param prog Program name (argv[0])
+ */
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [options]\n", prog);
+  fprintf(stderr, "  -M N      largest square size in the sweep (default 512, up to %d)\n", MAX_SWEEP);
+  fprintf(stderr, "  -T MS     minimum time per measurement in milliseconds (default 100)\n");
+  fprintf(stderr, "  -k LIST   kernels to run: alloc,gen,sum,multiply,display,batch (default all)\n");
+  fprintf(stderr, "  -f FMT    output format: table or csv (default table)\n");
+}
+
+/**
+ * @brief Opens a hardware cache-miss counter for this thread
+ *
+ * @return File descriptor, or -1 if perf events are unavailable
+ */
+static int open_cache_misses()
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief Frees the product of a batched pair, keeping the operands
+ */
+static void free_product(Matrix *m1, Matrix *m2, Matrix *product, long long taken, void *arg)
+{
+  FreeMatrix(product);
+}
+
+/**
+ * @brief Runs a kernel once on operands of the given shape
+ *
+ * Single-matrix kernels work on a (r x k); multiply computes a x b (k x c),
+ * and batch adds a x b to a batch, multiplying the batch every BENCH_BATCH pairs.
+ */
+static void run_kernel(int kernel, int r, int k, int c, Matrix *a, Matrix *b)
+{
+  Matrix *m;
+  switch (kernel) {
+    case K_ALLOC:
+      m = AllocMatrix(r, k);
+      FreeMatrix(m);
+      break;
+    case K_GEN:
+      GenMatrix(a);
+      break;
+    case K_SUM:
+      if (SumMatrix(a) == -1)  // keep the result alive
+        fputc(' ', devnull);
+      break;
+    case K_MULTIPLY:
+      m = MatrixMultiply(a, b);
+      FreeMatrix(m);
+      break;
+    case K_DISPLAY:
+      DisplayMatrix(a, devnull);
+      break;
+    case K_BATCH:
+      BatchAdd(batch, a, b, 0, free_product, NULL);
+      break;
+  }
+}
+
+/**
+ * @brief Bytes written by DisplayMatrix for one matrix
+ */
+static long display_bytes(Matrix *a)
+{
+  char *buf = NULL;
+  size_t len = 0;
+  FILE *mem = open_memstream(&buf, &len);
+  DisplayMatrix(a, mem);
+  fclose(mem);
+  free(buf);
+  return (long)len;
+}
+
+/**
+ * @brief Times a kernel on an (r x k) by (k x c) shape
+ *
+ * Doubles the iteration count until one batch takes at least min_ns.
+ */
+static Measurement measure(int kernel, int r, int k, int c, long long min_ns)
+{
+  Matrix *a = AllocMatrix(r, k);
+  Matrix *b = AllocMatrix(k, c);
+  GenMatrix(a);
+  GenMatrix(b);
+  run_kernel(kernel, r, k, c, a, b);  // warm up
+
+  long iters = 1;
+  long long elapsed = 0;
+  long long misses = -1;
+  while (1) {
+    if (perf_fd >= 0) {
+      ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    long long start = LatencyNow();
+    for (long i = 0; i < iters; i++)
+      run_kernel(kernel, r, k, c, a, b);
+    elapsed = LatencyNow() - start;
+    if (perf_fd >= 0) {
+      ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+        misses = -1;
+    }
+    if (elapsed >= min_ns)
+      break;
+    iters *= 2;
+  }
+
+  Measurement m;
+  m.iters = iters;
+  m.ns_per_op = (double)elapsed / iters;
+  m.misses_per_op = misses >= 0 ? (double)misses / iters : -1;
+  double elems = (double)r * k;
+  switch (kernel) {
+    case K_ALLOC:
+      m.gflops = 0;
+      m.bytes_per_op = sizeof(Matrix) + sizeof(int *) * r + sizeof(int) * elems;
+      break;
+    case K_GEN:
+      m.gflops = 0;
+      m.bytes_per_op = sizeof(int) * elems;
+      break;
+    case K_SUM:
+      m.gflops = elems / m.ns_per_op;
+      m.bytes_per_op = sizeof(int) * elems;
+      break;
+    case K_MULTIPLY:
+    case K_BATCH:
+      m.gflops = 2.0 * r * k * c / m.ns_per_op;
+      m.bytes_per_op = sizeof(int) * ((double)r * k + (double)k * c + (double)r * c);
+      break;
+    default:
+      m.gflops = 0;
+      m.bytes_per_op = display_bytes(a);
+  }
+  if (kernel == K_BATCH)
+    BatchFlush(batch, free_product, NULL);
+  FreeMatrix(a);
+  FreeMatrix(b);
+  return m;
+}
+
+int main (int argc, char * argv[])
+{
+  int max_size = 512;
+  long long min_ns = 100 * 1000000LL;
+  int csv = 0;
+  int enabled[NUM_KERNELS] = { 1, 1, 1, 1, 1, 1 };
+
+  int opt;
+  while ((opt = getopt(argc, argv, "M:T:k:f:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'M':
+        max_size = atoi(optarg);
+        if (max_size < 1 || max_size > MAX_SWEEP) {
+          usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'T':
+        min_ns = atoll(optarg) * 1000000LL;
+        break;
+      case 'k':
+        memset(enabled, 0, sizeof(enabled));
+        for (char *tok = strtok(optarg, ","); tok != NULL; tok = strtok(NULL, ",")) {
+          int found = 0;
+          for (int i = 0; i < NUM_KERNELS; i++) {
+            if (strcmp(tok, kernel_names[i]) == 0 || (i == K_ALLOC && strcmp(tok, "alloc") == 0)) {
+              enabled[i] = 1;
+              found = 1;
+            }
+          }
+          if (!found) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+          }
+        }
+        break;
+      case 'f':
+        csv = strcmp(optarg, "csv") == 0;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  // Random elements as in mode 0, and no per-multiply output
+  MATRIX_MODE = 0;
+  SHOW_RESULTS = 0;
+  srand(1);
+  devnull = fopen("/dev/null", "w");
+  perf_fd = open_cache_misses();
+  batch = BatchCreate(BENCH_BATCH);
+  if (perf_fd < 0 && !csv)
+    printf("(cache misses unavailable: perf_event_open not permitted here)\n");
+
+  // Shapes: every mode 0 shape (1-4 in each dimension), then squares up to max_size
+  int shapes[64][3];
+  int nshapes = 0;
+  for (int r = 1; r <= 4; r++)
+    for (int c = 1; c <= 4; c++) {
+      shapes[nshapes][0] = r;
+      shapes[nshapes][1] = c;
+      shapes[nshapes][2] = r;
+      nshapes++;
+    }
+  for (int n = 8; n <= max_size && nshapes < 64; n *= 2) {
+    shapes[nshapes][0] = shapes[nshapes][1] = shapes[nshapes][2] = n;
+    nshapes++;
+  }
+
+  if (csv)
+    printf("kernel,rows,inner,cols,iters,ns_per_op,gflops,bytes_per_op,cache_misses_per_op\n");
+  else
+    printf("%-11s %15s %10s %14s %9s %12s %14s\n", "kernel", "shape", "iters", "ns/op", "GFLOP/s", "bytes/op", "misses/op");
+
+  for (int kernel = 0; kernel < NUM_KERNELS; kernel++) {
+    if (!enabled[kernel])
+      continue;
+    for (int s = 0; s < nshapes; s++) {
+      int r = shapes[s][0], k = shapes[s][1], c = shapes[s][2];
+      if (kernel == K_BATCH && (r > BATCH_MAX_DIM || k > BATCH_MAX_DIM || c > BATCH_MAX_DIM))
+        continue;  // only small shapes are batched
+      Measurement m = measure(kernel, r, k, c, min_ns);
+      char shape[32];
+      if (kernel == K_MULTIPLY || kernel == K_BATCH)
+        snprintf(shape, sizeof(shape), "%dx%d*%dx%d", r, k, k, c);
+      else
+        snprintf(shape, sizeof(shape), "%dx%d", r, k);
+      if (csv) {
+        printf("%s,%d,%d,%d,%ld,%.2f,%.4f,%.0f,", kernel_names[kernel], r, k, c,
+               m.iters, m.ns_per_op, m.gflops, m.bytes_per_op);
+        if (m.misses_per_op >= 0)
+          printf("%.3f\n", m.misses_per_op);
+        else
+          printf("\n");
+      }
+      else {
+        printf("%-11s %15s %10ld %14.2f %9.3f %12.0f ", kernel_names[kernel], shape,
+               m.iters, m.ns_per_op, m.gflops, m.bytes_per_op);
+        if (m.misses_per_op >= 0)
+          printf("%14.3f\n", m.misses_per_op);
+        else
+          printf("%14s\n", "n/a");
+      }
+      fflush(stdout);
+    }
+  }
+
+  BatchDestroy(batch);
+  if (perf_fd >= 0)
+    close(perf_fd);
+  fclose(devnull);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+def wilcoxon_greater(differences):
+    """
+    One-sided exact Wilcoxon signed-rank test that paired differences are
+    positive (current slower than baseline). Zero differences are dropped
+    and tied magnitudes get their average rank.
+
+    Args:
+        differences (list): Per-block differences, current minus baseline.
+
+    Returns:
+        float: p-value; small values mean current is significantly slower.
+    """
+    nonzero = [d for d in differences if d != 0]
+    n = len(nonzero)
+    if n == 0:
+        return 1.0
+    magnitudes = sorted((abs(d), d > 0) for d in nonzero)
+
+    # Doubled average ranks over ties, so that every rank is an integer
+    ranks = [0] * n
+    i = 0
+    while i < n:
+        j = i
+        while j + 1 < n and magnitudes[j + 1][0] == magnitudes[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = i + j + 2
+        i = j + 1
+    observed = sum(r for r, (_, positive) in zip(ranks, magnitudes) if positive)
+
+    # Null distribution of the positive rank sum: each sign equally likely
+    counts = {0: 1}
+    for r in ranks:
+        shifted = dict(counts)
+        for total, ways in counts.items():
+            shifted[total + r] = shifted.get(total + r, 0) + ways
+        counts = shifted
+    return sum(ways for total, ways in counts.items() if total >= observed) / 2.0 ** n
+
+def median(values):
+    ordered = sorted(values)
+    mid = len(ordered) // 2
+    return ordered[mid] if len(ordered) % 2 else (ordered[mid - 1] + ordered[mid]) / 2.0
+
+def config_key(result):
+    return (result["workers"], result["buffer"], result["matrices"], result["mode"])
+
+def run_block(binary, bench_args, path):
+    """
+    Runs the benchmark set once with one binary.
+
+    Returns:
+        dict: Results of the block by configuration.
+    """
+    subprocess.run([binary] + bench_args + ["-f", "json", "-o", path], check=True)
+    with open(path) as f:
+        return {config_key(r): r for r in json.load(f)["results"]}
+
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(
+        description="Compare two pcBench binaries on one benchmark set, run in alternating blocks.")
+    parser.add_argument("baseline", help="pcBench built from the baseline revision")
+    parser.add_argument("current", help="pcBench of the build under test")
+    parser.add_argument("bench_args", nargs=argparse.REMAINDER,
+                        help="pcBench options of the set, after --")
+    parser.add_argument("--blocks", type=int, default=10,
+                        help="blocks each binary runs the whole set in (default 10)")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed relative drop of median throughput (default 0.10)")
+    parser.add_argument("--tail-tolerance", type=float, default=0.25,
+                        help="allowed relative growth of p90 run time (default 0.25)")
+    parser.add_argument("--alpha", type=float, default=0.01,
+                        help="significance level of the signed-rank test (default 0.01)")
+    args = parser.parse_args()
+    bench_args = args.bench_args[1:] if args.bench_args[:1] == ["--"] else args.bench_args
+
+    # Blocks alternate between the binaries, and so does which of them goes
+    # first, so drift in the host's load hits both alike; every comparison
+    # below pairs the two runs of one block.
+    blocks = []
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "block.json")
+        for block in range(args.blocks):
+            print(f"block {block + 1}/{args.blocks}", file=sys.stderr)
+            if block % 2 == 0:
+                base = run_block(args.baseline, bench_args, path)
+                cur = run_block(args.current, bench_args, path)
+            else:
+                cur = run_block(args.current, bench_args, path)
+                base = run_block(args.baseline, bench_args, path)
+            blocks.append((base, cur))
+
+    print(f"{'workers':>7} {'buffer':>6} {'matrices':>8} {'mode':>4} "
+          f"{'base p50':>9} {'cur p50':>9} {'tput':>7} "
+          f"{'base p90':>9} {'cur p90':>9} {'delta':>7} {'p-value':>8}  verdict")
+
+    failures = 0
+    for key in sorted(blocks[0][0]):
+        if any(key not in cur for _, cur in blocks):
+            print(f"{key[0]:>7} {key[1]:>6} {key[2]:>8} {key[3]:>4}  missing from current results")
+            failures += 1
+            continue
+        pairs = [(base[key], cur[key]) for base, cur in blocks]
+        base_p50 = median([b["p50_ms"] for b, _ in pairs])
+        cur_p50 = median([c["p50_ms"] for _, c in pairs])
+        base_p90 = median([b["p90_ms"] for b, _ in pairs])
+        cur_p90 = median([c["p90_ms"] for _, c in pairs])
+        tput_delta = median([b["p50_ms"] / c["p50_ms"] for b, c in pairs]) - 1
+        tail_delta = median([c["p90_ms"] / b["p90_ms"] for b, c in pairs]) - 1
+        p = wilcoxon_greater([math.log(c["p50_ms"] / b["p50_ms"]) for b, c in pairs])
+
+        # A regression must be both beyond tolerance and statistically significant
+        slower = p < args.alpha
+        verdict = "ok"
+        if slower and (tput_delta < -args.tolerance or tail_delta > args.tail_tolerance):
+            verdict = "REGRESSION"
+            failures += 1
+        elif slower:
+            verdict = "slower (within tolerance)"
+
+        print(f"{key[0]:>7} {key[1]:>6} {key[2]:>8} {key[3]:>4} "
+              f"{base_p50:>9.3f} {cur_p50:>9.3f} {tput_delta:>+7.1%} "
+              f"{base_p90:>9.3f} {cur_p90:>9.3f} {tail_delta:>+7.1%} {p:>8.4f}  {verdict}")
+
+    if failures:
+        print(f"\n{failures} configuration(s) regressed beyond {args.tolerance:.0%} throughput"
+              f" / {args.tail_tolerance:.0%} p90 (alpha={args.alpha}, {args.blocks} blocks)")
+        sys.exit(1)
+    print(f"\nNo regressions beyond {args.tolerance:.0%} throughput"
+          f" / {args.tail_tolerance:.0%} p90 (alpha={args.alpha}, {args.blocks} blocks)")
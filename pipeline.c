@@ -0,0 +1,395 @@
+/*
+ *  pipeline module
+ *  Pipeline contexts: the library interface of the engine (libpcmatrix.a)
+ *
+ *  A context owns a bounded buffer and everything a run of it needs. Each
+ *  run allocates the buffer storage, starts the configured number of
+ *  producers and consumers as threads or cooperative tasks according to
+ *  EXEC_MODE, waits for them and aggregates their ProdConsStats. The
+ *  buffer state is reset first, so a context can be run any number of
+ *  times (see pcbench.c). Contexts share the engine-wide settings; see
+ *  PipelineConfig in pipeline.h for when several can run at once.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+#include "matrix.h"
+#include "coop.h"
+#include "pool.h"
+#include "steal.h"
+#include "workload.h"
+#include "memory.h"
+#include "prodcons.h"
+#include "pcmatrix.h"
+#include "pipeline.h"
+
+/**
+ * @file pipeline.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief A pipeline context
+ */
+struct pipeline {
+  PipelineConfig cfg;
+  Buffer buffer;
+  double start;                 /**< start time of the run in progress */
+  int running;                  /**< a run is in progress, protected by report_lock */
+  /** Wakes the progress reporter early when the run is over */
+  pthread_mutex_t report_lock;
+  pthread_cond_t report_cv;
+  int finished;
+};
+
+/** Buffer capacity the matrix pool was sized for, and whether a run holds its buffer */
+static int pool_buffer_size = 0;
+static int pool_claimed = 0;
+
+static double now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Progress reporter thread of a run with a duration or report interval
+ *
+ * Prints production, consumption and multiplication rates over each
+ * report interval, and stops the producers once the duration has elapsed.
+ *
+ * @param arg Pipeline of the run (Pipeline *)
+ * @return NULL
+ */
+static void *reporter(void *arg)
+{
+  Pipeline *p = (Pipeline *)arg;
+  double start = p->start;
+  double deadline = p->cfg.duration > 0 ? start + p->cfg.duration : 0;
+  double next_report = p->cfg.report_interval > 0 ? start + p->cfg.report_interval : 0;
+  double last = start;
+  int last_produced = 0, last_consumed = 0;
+  long long last_multiplied = 0;
+
+  while (1) {
+    // Sleep until the next report or the deadline, whichever comes first
+    double wake = next_report;
+    if (deadline > 0 && (wake == 0 || deadline < wake))
+      wake = deadline;
+    pthread_mutex_lock(&p->report_lock);
+    while (!p->finished) {
+      if (wake == 0) {
+        pthread_cond_wait(&p->report_cv, &p->report_lock);
+        continue;
+      }
+      if (now_seconds() >= wake)
+        break;
+      struct timespec ts;
+      ts.tv_sec = (time_t)wake;
+      ts.tv_nsec = (long)((wake - ts.tv_sec) * 1e9);
+      pthread_cond_timedwait(&p->report_cv, &p->report_lock, &ts);
+    }
+    int over = p->finished;
+    pthread_mutex_unlock(&p->report_lock);
+    if (over)
+      break;
+
+    double now = now_seconds();
+    if (deadline > 0 && now >= deadline) {
+      StopProducers(&p->buffer);  // consumers drain what is left in the buffer
+      deadline = 0;
+    }
+    if (next_report > 0 && now >= next_report) {
+      int produced, consumed;
+      long long multiplied;
+      BufferProgress(&p->buffer, &produced, &consumed, &multiplied);
+      double dt = now - last;
+      flockfile(stdout);
+      printf("[%8.2fs] produced=%d (%.0f/s) consumed=%d (%.0f/s) multiplied=%lld (%.0f/s)",
+             now - start, produced, (produced - last_produced) / dt,
+             consumed, (consumed - last_consumed) / dt,
+             multiplied, (multiplied - last_multiplied) / dt);
+      if (MEMORY_STATS) {
+        MemoryUsage mem;
+        MemorySnapshot(&mem);
+        printf(" live=%lld (%.1f MiB, peak %.1f MiB) rss=%.1f MiB", mem.matrices,
+               mem.bytes / 1048576.0, mem.peak / 1048576.0, mem.rss / 1048576.0);
+      }
+      printf("\n");
+      fflush(stdout);
+      funlockfile(stdout);
+      last = now;
+      last_produced = produced;
+      last_consumed = consumed;
+      last_multiplied = multiplied;
+      next_report += p->cfg.report_interval;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * @brief Creates a pipeline context
+ *
+ * The context copies the configuration; every other setting of
+ * pcmatrix.h is read from the process-wide globals when the context runs.
+ *
+ * @param cfg Configuration of the context
+ * @return New context, or NULL if the configuration is invalid
+ */
+Pipeline *PipelineCreate(const PipelineConfig *cfg)
+{
+  if (cfg->workers < 1 || cfg->buffer_size < 1 || cfg->matrices < 0)
+    return NULL;
+  Pipeline *p = (Pipeline *)malloc(sizeof(Pipeline));
+  assert(p != NULL);
+  p->cfg = *cfg;
+  InitBuffer(&p->buffer);
+  p->buffer.size = cfg->buffer_size;
+  p->buffer.matrices = cfg->matrices;
+  p->buffer.workers = cfg->workers;
+  p->buffer.generator = cfg->generator;
+  p->buffer.result = cfg->result;
+  p->buffer.user = cfg->user;
+  p->running = 0;
+  pthread_mutex_init(&p->report_lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&p->report_cv, &attr);
+  pthread_condattr_destroy(&attr);
+  return p;
+}
+
+/**
+ * @brief Produces and consumes the configured number of matrices
+ *
+ * Runs the configured number of producers and of consumers and returns
+ * once they are done. With a duration set, production stops after that
+ * many seconds instead if it comes first; with a report interval set,
+ * rates are printed as it runs.
+ *
+ * @param p Context to run
+ * @param totals Filled with the statistics aggregated over all workers
+ * @return 0 on success, -1 if a run of this context is already in progress
+ */
+int PipelineRun(Pipeline *p, PipelineTotals *totals)
+{
+  pthread_mutex_lock(&p->report_lock);
+  int busy = p->running;
+  p->running = 1;
+  pthread_mutex_unlock(&p->report_lock);
+  if (busy)
+    return -1;
+
+  // Allocate memory for the bounded buffer, inside the matrix pool if it is free
+  Buffer *b = &p->buffer;
+  int numw = p->cfg.workers;
+  Matrix **pooled = NULL;
+  if (p->cfg.buffer_size <= pool_buffer_size && !__atomic_exchange_n(&pool_claimed, 1, __ATOMIC_ACQUIRE)) {
+    pooled = (Matrix **) PoolBuffer();
+    if (pooled == NULL)
+      __atomic_store_n(&pool_claimed, 0, __ATOMIC_RELEASE);
+  }
+  b->bigmatrix = pooled != NULL ? pooled : (Matrix **) malloc(sizeof(Matrix *) * b->size);
+  ResetBuffer(b);
+  long long storage = sizeof(Matrix *) * (long long)b->size;
+  if (b->slots != NULL)
+    storage += (long long)b->slot_size * b->size;
+  if (b->keys != NULL)
+    storage += sizeof(double) * (long long)b->size;
+  if (MEMORY_STATS)
+    MemoryStorage(storage);
+
+  // Start the clock, and the progress reporter if the run is timed or reported
+  p->start = now_seconds();
+  int reporting = p->cfg.duration > 0 || p->cfg.report_interval > 0;
+  pthread_t rep;
+  if (reporting) {
+    p->finished = 0;
+    if (pthread_create(&rep, NULL, reporter, p) != 0) {
+      perror("Reporter Thread");
+      reporting = 0;
+    }
+  }
+
+  // Consumers multiply pairs, or whole chains in chain mode, or small pairs
+  // in batches, or share the products of their pairs through work-stealing deques
+  void *(*consumer)(void *) = cons_worker;
+  if (CHAIN_LENGTH > 0)
+    consumer = cons_chain_worker;
+  else if (BATCH_SIZE > 0)
+    consumer = cons_batch_worker;
+  else if (WORK_STEALING) {
+    consumer = cons_steal_worker;
+    b->steal = StealInit(numw);
+  }
+
+  // Declare arrays to hold producer and consumer thread IDs
+  pthread_t pr[numw];
+  pthread_t co[numw];
+  // Task handles used instead of threads in EXEC_TASKS mode
+  coop_task_t *prt[numw];
+  coop_task_t *cot[numw];
+
+  if (EXEC_MODE == EXEC_TASKS) {
+    // Spawn producer and consumer tasks, then run them on the scheduler pool
+    for (int i = 0; i < numw; i++) {
+      prt[i] = coop_spawn(prod_worker, b);
+      cot[i] = coop_spawn(consumer, b);
+    }
+    coop_run(SCHED_WORKERS);
+  }
+  else {
+    // Create producer and consumer threads
+    for (int i = 0; i < numw; i++) {
+      if(pthread_create(&pr[i], NULL, prod_worker, b) != 0) {
+        perror("Producer Thread");
+      }
+      if (pthread_create(&co[i], NULL, consumer, b) != 0) {
+        perror("Consumer Thread");
+      }
+    }
+  }
+
+  // Initialize aggregate statistics
+  totals->produced = 0;
+  totals->consumed = 0;
+  totals->prodsum = 0;
+  totals->conssum = 0;
+  totals->productsum = 0;
+  totals->multiplied = 0;
+  totals->chaincost = 0;
+  totals->naivecost = 0;
+  totals->tasks = 0;
+  totals->stolen = 0;
+
+  // Pointer to hold returned statistics from threads
+  ProdConsStats *stats;
+  long long idlens = 0;
+  double ended[numw];  // when each consumer finished
+
+  // Join all threads and collect their statistics
+  for (int i = 0; i < numw; i++) {
+
+    // Join producer threads and collect their stats
+    if (EXEC_MODE == EXEC_TASKS)
+      stats = coop_join(prt[i]);
+    else
+      pthread_join(pr[i], (void**)&stats);
+    totals->prodsum += stats->sumtotal;
+    totals->produced += stats->matrixtotal;
+    free(stats);
+
+    // Join consumer threads and collect their stats
+    if (EXEC_MODE == EXEC_TASKS)
+      stats = coop_join(cot[i]);
+    else
+      pthread_join(co[i], (void**)&stats);
+    totals->conssum += stats->sumtotal;
+    totals->productsum += stats->productsum;
+    totals->consumed += stats->matrixtotal;
+    totals->multiplied += stats->multtotal;
+    totals->chaincost += stats->chaincost;
+    totals->naivecost += stats->naivecost;
+    idlens += stats->idlens;
+    ended[i] = stats->endns / 1e9;
+    free(stats);
+  }
+
+  // Consumers are idle while waiting for matrices and once they finish before the run ends
+  double end = now_seconds();
+  totals->seconds = end - p->start;
+  totals->idle = idlens / 1e9;
+  for (int i = 0; i < numw; i++)
+    totals->idle += end - ended[i];
+
+  if (b->steal != NULL) {
+    totals->tasks = b->steal->pushed;
+    totals->stolen = b->steal->stolen;
+    StealDestroy(b->steal);
+    b->steal = NULL;
+  }
+
+  // Stop the reporter
+  if (reporting) {
+    pthread_mutex_lock(&p->report_lock);
+    p->finished = 1;
+    pthread_cond_signal(&p->report_cv);
+    pthread_mutex_unlock(&p->report_lock);
+    pthread_join(rep, NULL);
+  }
+
+  // Clean up allocated memory for the buffer
+  if (MEMORY_STATS)
+    MemoryStorage(-storage);
+  if (pooled == NULL)
+    free(b->bigmatrix);
+  else
+    __atomic_store_n(&pool_claimed, 0, __ATOMIC_RELEASE);
+  b->bigmatrix = NULL;
+
+  pthread_mutex_lock(&p->report_lock);
+  p->running = 0;
+  pthread_mutex_unlock(&p->report_lock);
+  return 0;
+}
+
+/**
+ * @brief Ends production of the run in progress early
+ *
+ * May be called from any thread, including the callbacks. Matrices already
+ * in the buffer are still consumed, and PipelineRun() returns once they are.
+ */
+void PipelineStop(Pipeline *p)
+{
+  StopProducers(&p->buffer);
+}
+
+/**
+ * @brief Releases a context; it must not be running
+ */
+void PipelineDestroy(Pipeline *p)
+{
+  DestroyBuffer(&p->buffer);
+  pthread_mutex_destroy(&p->report_lock);
+  pthread_cond_destroy(&p->report_cv);
+  free(p);
+}
+
+/**
+ * @brief Reserves the huge-page matrix pool for a configuration
+ *
+ * Sizes the slots for MATRIX_MODE or workload shapes and their count for a full buffer
+ * plus every matrix a producer or consumer can hold at once, with the
+ * buffer itself in front. One run at a time keeps its buffer in the pool.
+ * Does nothing unless POOL_MODE is set; call PoolDestroy() once the runs
+ * using it are over.
+ *
+ * @param cfg Configuration of the contexts that will use the pool
+ * @return 0 on success or when no pool is wanted, -1 if it cannot be mapped
+ */
+int PipelinePoolInit(const PipelineConfig *cfg)
+{
+  if (POOL_MODE == 0)
+    return 0;
+  int maxrows = MATRIX_MODE > 0 ? MATRIX_MODE : 4;
+  int maxelems = maxrows * maxrows;
+  if (WORKLOAD_SPEC != NULL)
+    WorkloadBounds(&maxrows, &maxelems);
+  int held = CHAIN_LENGTH > 0 ? CHAIN_LENGTH + 1 : 3;  // a consumer's operands and product
+  int slots = cfg->buffer_size + cfg->workers * (2 + held) + CACHE_SIZE * 3;
+  pool_buffer_size = cfg->buffer_size;
+  return PoolInit(slots, maxrows, maxelems, cfg->buffer_size, POOL_MODE == 2);
+}
@@ -0,0 +1,67 @@
+/*
+ *  pipeline header
+ *  Function prototypes, data, and constants for pipeline module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Totals of one run, aggregated over every producer and consumer
+// produced/consumed - number of matrices produced and consumed
+// prodsum/conssum   - sum of all elements of the matrices produced and consumed
+// productsum        - sum of all elements of the products, computed or lazy
+// multiplied        - number of multiplications
+// chaincost         - scalar multiplications done by chain consumers
+// naivecost         - scalar multiplications a left-to-right order would need
+// seconds           - wall-clock duration of the run (its makespan)
+// idle              - consumer seconds spent waiting for matrices or done early
+// tasks/stolen      - tasks pushed on work-stealing deques, and those stolen
+typedef struct pipeline_totals {
+  int produced;
+  int consumed;
+  int prodsum;
+  int conssum;
+  int productsum;
+  int multiplied;
+  long long chaincost;
+  long long naivecost;
+  double seconds;
+  double idle;
+  long tasks;
+  long stolen;
+} PipelineTotals;
+
+// Configuration of one pipeline context
+// workers         - producers, and consumers
+// buffer_size     - capacity of the bounded buffer
+// matrices        - matrices to produce
+// duration        - seconds after which production stops, 0 for no limit
+// report_interval - seconds between progress reports, 0 for none
+// generator       - supplies the matrices, NULL for INPUT_PATH, WORKLOAD_SPEC or MATRIX_MODE
+// result          - receives every product, or NULL
+// user            - passed to generator and result
+// Only these settings belong to a context. The rest of pcmatrix.h (matrix
+// mode, execution mode, buffer order, chain length, batch, inline and
+// work-stealing settings, storage, verification) is process-wide and read
+// by every context, and cooperative tasks share one run queue. Contexts
+// may run at the same time only with EXEC_THREADS and their own
+// generators, since the built-in generators keep process-wide state.
+typedef struct pipeline_config {
+  int workers;
+  int buffer_size;
+  int matrices;
+  double duration;
+  double report_interval;
+  MatrixGenerator generator;
+  ProductResult result;
+  void * user;
+} PipelineConfig;
+
+typedef struct pipeline Pipeline;
+
+// pipeline methods
+Pipeline * PipelineCreate(const PipelineConfig *cfg);
+int PipelineRun(Pipeline *p, PipelineTotals *totals);
+void PipelineStop(Pipeline *p);
+void PipelineDestroy(Pipeline *p);
+int PipelinePoolInit(const PipelineConfig *cfg);
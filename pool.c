@@ -0,0 +1,233 @@
+/*
+ *  Huge-page matrix pool routines
+ *  Preallocated, huge-page backed storage for matrices and the buffer
+ *
+ *  One region is mapped up front and divided into the bounded buffer
+ *  followed by equal slots, each holding one matrix of up to maxrows
+ *  rows and maxelems elements. The region is mapped with explicit huge
+ *  pages (MAP_HUGETLB) when the system has some reserved, otherwise with
+ *  normal pages and MADV_HUGEPAGE so transparent huge pages can back it.
+ *  Large matrices then span a few TLB entries instead of one per 4 KiB.
+ *  Pre-faulting touches every page at startup so the first multiplies
+ *  do not pay for page faults. AllocMatrix() takes slots from here while
+ *  the pool is active and falls back to malloc() for matrices that do
+ *  not fit or when every slot is in use.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "matrix.h"
+#include "pool.h"
+
+/**
+ * @file pool.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Header of a free slot, overlaid on its Matrix header
+ */
+typedef struct pool_slot {
+  struct pool_slot *next;
+} PoolSlot;
+
+static const char *backing_names[] = { "explicit huge pages (MAP_HUGETLB)",
+                                       "transparent huge pages (MADV_HUGEPAGE)",
+                                       "4 KiB pages" };
+
+/** Mapped region, NULL while the pool is inactive */
+static char *region = NULL;
+static size_t region_size = 0;
+static int backing = POOL_SMALL;
+static int prefaulted = 0;
+
+/** Slot layout */
+static char *slots_base = NULL;
+static size_t slot_size = 0;
+static int nslots = 0;
+static int slot_rows = 0;
+static int slot_elems = 0;
+
+/** Free slots, protected by pool_lock */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static PoolSlot *free_slots = NULL;
+static int in_use = 0;
+static int peak = 0;
+static long long pooled = 0;
+static long long fallbacks = 0;
+
+static size_t round_up(size_t n, size_t align)
+{
+  return (n + align - 1) & ~(align - 1);
+}
+
+/**
+ * @brief Maps the pool region, preferring explicit then transparent huge pages
+ */
+static char *map_region(size_t size)
+{
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    backing = POOL_HUGETLB;
+    return (char *)p;
+  }
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  backing = madvise(p, size, MADV_HUGEPAGE) == 0 ? POOL_THP : POOL_SMALL;
+  return (char *)p;
+}
+
+/**
+ * @brief Reserves the pool; AllocMatrix() uses it until PoolDestroy()
+ *
+ * @param slots Number of matrix slots
+ * @param maxrows Largest row count a slot holds
+ * @param maxelems Largest element count (rows x cols) a slot holds
+ * @param buffer_entries Bounded buffer entries placed in front of the slots
+ * @param prefault Nonzero to touch every page now instead of on first use
+ * @return 0 on success, -1 if the region cannot be mapped (matrices stay on the heap)
+ */
+int PoolInit(int slots, int maxrows, int maxelems, int buffer_entries, int prefault)
+{
+  assert(region == NULL);
+  slot_rows = maxrows;
+  slot_elems = maxelems;
+  nslots = slots;
+  slot_size = round_up(round_up(sizeof(Matrix), sizeof(int *)) + sizeof(int *) * maxrows, POOL_ALIGN)
+            + round_up(sizeof(int) * (size_t)maxelems, POOL_ALIGN);
+  size_t buffer = round_up(sizeof(Matrix *) * (size_t)buffer_entries, POOL_ALIGN);
+  region_size = round_up(buffer + slot_size * (size_t)slots, POOL_HUGE_PAGE);
+
+  region = map_region(region_size);
+  if (region == NULL) {
+    perror("pool mmap");
+    return -1;
+  }
+  slots_base = region + buffer;
+
+  // Touch every page so the faults are taken here, not in the pipeline
+  prefaulted = prefault;
+  if (prefault) {
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < region_size; off += page)
+      region[off] = 0;
+  }
+
+  // Thread the slots on the free list in address order
+  free_slots = NULL;
+  for (int i = slots - 1; i >= 0; i--) {
+    PoolSlot *s = (PoolSlot *)(slots_base + slot_size * (size_t)i);
+    s->next = free_slots;
+    free_slots = s;
+  }
+  in_use = peak = 0;
+  pooled = fallbacks = 0;
+  return 0;
+}
+
+/**
+ * @brief Storage for the bounded buffer inside the pool region
+ *
+ * @return Array of buffer_entries pointers, or NULL when the pool is inactive
+ */
+void *PoolBuffer()
+{
+  return region;
+}
+
+/**
+ * @brief Takes a slot for an r x c matrix
+ *
+ * @return Matrix with storage MATRIX_POOL, or NULL if the pool is inactive,
+ *         the shape does not fit a slot or every slot is in use
+ */
+Matrix *PoolAllocMatrix(int r, int c)
+{
+  if (region == NULL)
+    return NULL;
+  if (r > slot_rows || (long long)r * c > slot_elems) {
+    __atomic_fetch_add(&fallbacks, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  pthread_mutex_lock(&pool_lock);
+  PoolSlot *s = free_slots;
+  if (s != NULL) {
+    free_slots = s->next;
+    if (++in_use > peak)
+      peak = in_use;
+    pooled++;
+  }
+  else {
+    fallbacks++;
+  }
+  pthread_mutex_unlock(&pool_lock);
+  if (s == NULL)
+    return NULL;
+
+  char *base = (char *)s;
+  Matrix *mat = (Matrix *)base;
+  int **rows = (int **)(base + round_up(sizeof(Matrix), sizeof(int *)));
+  int *data = (int *)(base + slot_size - round_up(sizeof(int) * (size_t)slot_elems, POOL_ALIGN));
+  for (int i = 0; i < r; i++)
+    rows[i] = data + (size_t)i * c;
+  mat->m = rows;
+  mat->rows = r;
+  mat->cols = c;
+  mat->storage = MATRIX_POOL;
+  mat->csr = NULL;
+  return mat;
+}
+
+/**
+ * @brief Returns the slot of a MATRIX_POOL matrix
+ */
+void PoolFree(Matrix *mat)
+{
+  PoolSlot *s = (PoolSlot *)mat;
+  pthread_mutex_lock(&pool_lock);
+  s->next = free_slots;
+  free_slots = s;
+  in_use--;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/**
+ * @brief Prints the pool layout and how many allocations it served
+ */
+void PoolReport(FILE *stream)
+{
+  if (region == NULL)
+    return;
+  fprintf(stream, "Matrix pool --> %.1f MiB on %s%s, %d slots of %zu bytes (up to %d rows, %d elements)\n",
+          region_size / (1024.0 * 1024.0), backing_names[backing], prefaulted ? ", pre-faulted" : "",
+          nslots, slot_size, slot_rows, slot_elems);
+  fprintf(stream, "Matrix pool allocations --> pooled=%lld heap fallbacks=%lld peak slots in use=%d\n",
+          pooled, fallbacks, peak);
+}
+
+/**
+ * @brief Unmaps the pool; every pooled matrix must have been freed
+ */
+void PoolDestroy()
+{
+  if (region == NULL)
+    return;
+  assert(in_use == 0);
+  munmap(region, region_size);
+  region = NULL;
+  slots_base = NULL;
+  free_slots = NULL;
+}
@@ -0,0 +1,30 @@
+/*
+ *  pool header
+ *  Function prototypes, data, and constants for huge-page matrix pool module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// HUGE-PAGE MATRIX POOL (preallocated slots for matrices and the buffer)
+
+// Huge page size assumed for alignment and for explicit MAP_HUGETLB mappings
+#define POOL_HUGE_PAGE (2 * 1024 * 1024)
+
+// Alignment of every slot's elements
+#define POOL_ALIGN 64
+
+// How the pool region is backed, as reported by PoolReport()
+#define POOL_HUGETLB 0
+#define POOL_THP 1
+#define POOL_SMALL 2
+
+struct matrix;
+
+// pool methods
+int PoolInit(int slots, int maxrows, int maxelems, int buffer_entries, int prefault);
+void * PoolBuffer();
+struct matrix * PoolAllocMatrix(int r, int c);
+void PoolFree(struct matrix *mat);
+void PoolReport(FILE *stream);
+void PoolDestroy();
@@ -13,9 +13,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <math.h>
+#include <assert.h>
+#include <string.h>
 #include "counter.h"
+#include "arena.h"
 #include "matrix.h"
+#include "chain.h"
+#include "cache.h"
+#include "sparse.h"
+#include "workload.h"
+#include "latency.h"
+#include "input.h"
+#include "instrument.h"
+#include "trace.h"
+#include "steal.h"
+#include "batch.h"
+#include "verify.h"
+#include "memory.h"
 #include "pcmatrix.h"
+#include "coop.h"
 #include "prodcons.h"
 
 /**
@@ -26,38 +43,287 @@
  */
 
 /**
- * Global variables for the producer-consumer buffer management
+ * @brief Buffer slot when INLINE_MAX is set
+ *
+ * A dense matrix of up to INLINE_MAX elements is embedded by value, so
+ * the buffer holds its elements contiguously; a larger one by pointer.
  */
+typedef struct slot {
+  Matrix *ptr;        /**< matrix held by pointer, NULL when embedded */
+  int rows, cols;
+  long long born, queued;
+  int data[];         /**< rows x cols elements, row-major */
+} Slot;
+
 
 /**
- * @brief Mutex lock for synchronizing access to shared resources.
- * This mutex is used to protect critical sections in the producer-consumer pattern.
+ * @brief Acquires the buffer lock
  */
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static inline void lock_buffer(Buffer *b)
+{
+  instr_lock(&b->lock);
+}
 
 /**
- * @brief Condition variable to signal when the buffer is full.
- * Producers wait on this condition when the buffer has no space available.
+ * @brief Releases the buffer lock
  */
-pthread_cond_t full = PTHREAD_COND_INITIALIZER;
+static inline void unlock_buffer(Buffer *b)
+{
+  instr_unlock(&b->lock);
+}
 
 /**
- * @brief Condition variable to signal when the buffer is empty.
- * Consumers wait on this condition when there are no items in the buffer to consume.
+ * @brief Waits on a buffer condition, releasing the buffer lock meanwhile
+ *
+ * Threads block in pthread_cond_wait(); tasks yield their kernel thread
+ * to other runnable tasks until signalled.
+ *
+ * @param c Condition to wait on (full or empty)
  */
-pthread_cond_t empty = PTHREAD_COND_INITIALIZER;
+static void cond_wait(Buffer *b, pc_cond_t *c)
+{
+  long long traced = trace_begin();
+  long long start = instr_wait_begin();
+  if (EXEC_MODE == EXEC_TASKS)
+    coop_cond_wait(&c->tasks, &b->lock);
+  else
+    pthread_cond_wait(&c->cv, &b->lock);
+  instr_wait_end(start);
+  if (MEMORY_STATS)
+    MemoryRole(c == &b->empty ? MEM_PRODUCER : MEM_CONSUMER);  // a task may resume on another thread
+  trace_end(c == &b->empty ? TRACE_WAIT_FULL : TRACE_WAIT_EMPTY, traced);
+}
 
-/** Position where producer will put next item */
-int fill = 0;
-/** Position where consumer will get next item */
-int use = 0;
-/** State counter of items currently in buffer */
-int count = 0;
-/** State variable matrix_count Number of matrices processed */
-int matrix_count = 0;
-/** State Flag indicating completion status (0: not done, numwork: done) */
-int done = 0;
+/**
+ * @brief Wakes one waiter of a buffer condition; the buffer lock must be held
+ *
+ * @param c Condition to signal (full or empty)
+ */
+static void cond_signal(pc_cond_t *c)
+{
+  if (EXEC_MODE == EXEC_TASKS)
+    coop_cond_signal(&c->tasks);
+  else
+    pthread_cond_signal(&c->cv);
+}
 
+/**
+ * @brief Initializes the lock and conditions of a buffer, with no storage yet
+ *
+ * The caller sets bigmatrix, size, matrices, workers and the callbacks,
+ * then calls ResetBuffer() before each run.
+ */
+void InitBuffer(Buffer *b)
+{
+  memset(b, 0, sizeof(Buffer));
+  pthread_mutex_init(&b->lock, NULL);
+  pthread_cond_init(&b->full.cv, NULL);
+  pthread_cond_init(&b->empty.cv, NULL);
+  b->full.tasks = (coop_cond_t)COOP_COND_INITIALIZER;
+  b->empty.tasks = (coop_cond_t)COOP_COND_INITIALIZER;
+}
+
+/**
+ * @brief Releases what InitBuffer() and ResetBuffer() allocated
+ *
+ * bigmatrix belongs to the caller and is left alone.
+ */
+void DestroyBuffer(Buffer *b)
+{
+  free(b->keys);
+  free(b->slots);
+  b->keys = NULL;
+  b->slots = NULL;
+  pthread_mutex_destroy(&b->lock);
+  pthread_cond_destroy(&b->full.cv);
+  pthread_cond_destroy(&b->empty.cv);
+}
+
+/**
+ * @brief Empties the bounded buffer and clears the production state
+ *
+ * Must be called before starting producers and consumers on a new run.
+ */
+void ResetBuffer(Buffer *b)
+{
+  b->fill = 0;
+  b->use = 0;
+  b->count = 0;
+  b->matrix_count = 0;
+  b->done = 0;
+  b->stopping = 0;
+  b->multiplied_count = 0;
+  b->put_seq = 0;
+  free(b->slots);
+  b->slots = NULL;
+  if (INLINE_MAX > 0 && BUFFER_ORDER == BUFFER_FIFO) {
+    b->slot_size = (sizeof(Slot) + sizeof(int) * INLINE_MAX + 7) & ~(size_t)7;
+    b->slots = (char *)malloc(b->slot_size * b->size);
+    assert(b->slots != NULL);
+  }
+  if (BUFFER_ORDER == BUFFER_PRIORITY) {
+    b->keys = (double *)realloc(b->keys, sizeof(double) * b->size);
+    assert(b->keys != NULL);
+  }
+}
+
+/**
+ * @brief Priority of a matrix about to be buffered, higher is served first
+ *
+ * The estimated multiply cost is rows x inner x cols, taking the unknown
+ * partner to be as wide as this matrix is (rows x cols x cols). Its log2
+ * is aged by the puts made while the matrix waits: every AGING later puts
+ * count as one doubling of cost, so a cheap matrix waits at most about
+ * AGING x log2(largest cost) puts. The aging term is folded into a fixed
+ * key (-put_seq / AGING), which keeps heap order valid as time passes.
+ */
+static double priority_key(Buffer *b, Matrix *m)
+{
+  double cost = (double)m->rows * m->cols * m->cols;
+  return log2(cost) - (double)b->put_seq / AGING;
+}
+
+/**
+ * @brief Swaps two heap entries
+ */
+static void heap_swap(Buffer *b, int i, int j)
+{
+  Matrix *m = b->bigmatrix[i];
+  double k = b->keys[i];
+  b->bigmatrix[i] = b->bigmatrix[j];
+  b->keys[i] = b->keys[j];
+  b->bigmatrix[j] = m;
+  b->keys[j] = k;
+}
+
+/**
+ * @brief Restores heap order around entry i of a heap of n entries
+ */
+static void heap_fix(Buffer *b, int i, int n)
+{
+  while (i > 0 && b->keys[(i - 1) / 2] < b->keys[i]) {
+    heap_swap(b, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  while (1) {
+    int l = 2 * i + 1, r = l + 1, top = i;
+    if (l < n && b->keys[l] > b->keys[top])
+      top = l;
+    if (r < n && b->keys[r] > b->keys[top])
+      top = r;
+    if (top == i)
+      break;
+    heap_swap(b, i, top);
+    i = top;
+  }
+}
+
+/**
+ * @brief Removes entry i from the heap of count entries
+ */
+static Matrix *heap_take(Buffer *b, int i)
+{
+  Matrix *m = b->bigmatrix[i];
+  b->bigmatrix[i] = b->bigmatrix[b->count - 1];
+  b->keys[i] = b->keys[b->count - 1];
+  if (i < b->count - 1)
+    heap_fix(b, i, b->count - 1);
+  return m;
+}
+
+/**
+ * @brief Stores a matrix in slot i, embedding it by value if it is small enough
+ *
+ * An embedded matrix is freed; MATRIX_SMALL storage goes back to the
+ * producer's own free list, so producers and consumers each reuse the
+ * matrices they free instead of passing storage between threads.
+ *
+ * @return 1 if the matrix was embedded (and freed), 0 if it is held by pointer
+ */
+static int store_slot(Buffer *b, int i, Matrix *m)
+{
+  Slot *s = (Slot *)(b->slots + i * b->slot_size);
+  if (m->csr != NULL || m->rows * m->cols > INLINE_MAX) {
+    s->ptr = m;
+    return 0;
+  }
+  s->ptr = NULL;
+  s->rows = m->rows;
+  s->cols = m->cols;
+  s->born = m->born;
+  s->queued = m->queued;
+  for (int r = 0; r < m->rows; r++)
+    memcpy(s->data + r * m->cols, m->m[r], sizeof(int) * m->cols);
+  FreeMatrix(m);
+  return 1;
+}
+
+/**
+ * @brief Hands a matrix held by the buffer over to the consumer taking it
+ */
+static Matrix *unbuffered(Matrix *m)
+{
+  if (MEMORY_STATS)
+    MemoryMove(MEM_BUFFER, MEM_CONSUMER, MatrixBytes(m));
+  return m;
+}
+
+/**
+ * @brief Returns the matrix of slot i, copying an embedded one out by value
+ */
+static Matrix *load_slot(Buffer *b, int i)
+{
+  Slot *s = (Slot *)(b->slots + i * b->slot_size);
+  if (s->ptr != NULL)
+    return unbuffered(s->ptr);
+  Matrix *m = AllocMatrix(s->rows, s->cols);
+  for (int r = 0; r < s->rows; r++)
+    memcpy(m->m[r], s->data + r * s->cols, sizeof(int) * s->cols);
+  m->born = s->born;
+  m->queued = s->queued;
+  return m;
+}
+
+/**
+ * @brief Bookkeeping shared by every way of taking a matrix out of the buffer
+ */
+static Matrix *taken(Buffer *b, Matrix *matrix)
+{
+  b->count--;                               // Decrement the count of items in buffer
+  instr_occupancy(b->count, b->size);
+  if (LATENCY)
+    LatencyRecord(LAT_QUEUE, matrix->queued);
+  return matrix;                         // Return the retrieved matrix pointer
+}
+
+/**
+ * @brief Makes producers stop as if NUMBER_OF_MATRICES had been reached
+ *
+ * Matrices already in the buffer are still consumed, so the run drains
+ * and ends normally.
+ */
+void StopProducers(Buffer *b)
+{
+  lock_buffer(b);
+  b->stopping = 1;
+  unlock_buffer(b);
+}
+
+/**
+ * @brief Snapshot of the run's progress so far
+ *
+ * @param produced Matrices put in the buffer
+ * @param consumed Matrices taken out of the buffer
+ * @param multiplied Multiplications completed
+ */
+void BufferProgress(Buffer *b, int *produced, int *consumed, long long *multiplied)
+{
+  lock_buffer(b);
+  *produced = b->matrix_count;
+  *consumed = b->matrix_count - b->count;
+  unlock_buffer(b);
+  *multiplied = __atomic_load_n(&b->multiplied_count, __ATOMIC_RELAXED);
+}
 
 /**
  * @brief Adds a matrix to the bounded buffer
@@ -68,12 +334,31 @@ int done = 0;
  * @param value Pointer to the Matrix to be added to the buffer
  * @return EXIT_SUCCESS on successful addition
  */
-int put(Matrix * value)
+int put(Buffer *b, Matrix * value)
 {
-  bigmatrix[fill] = value;                  // Store the matrix pointer at the current fill position in the buffer
-  fill = (fill + 1) % BOUNDED_BUFFER_SIZE;  // Advance fill index with wrap-around when reaching buffer end
-  count++;                                  // Increment the count of items currently in the buffer
-  matrix_count++;                           // Increment the total count of matrices processed so far
+  if (LATENCY)
+    value->queued = LatencyNow();           // Stamp the matrix to measure its time in the buffer
+  long long bytes = MEMORY_STATS ? MatrixBytes(value) : 0;  // the buffer holds it from here on
+  if (BUFFER_ORDER == BUFFER_PRIORITY) {
+    b->bigmatrix[b->count] = value;               // Append to the heap and sift it into place
+    b->keys[b->count] = priority_key(b, value);
+    heap_fix(b, b->count, b->count + 1);
+    b->put_seq++;
+  }
+  else if (b->slots != NULL) {
+    if (store_slot(b, b->fill, value))              // Embed the matrix in the slot, or store its pointer
+      bytes = 0;                                    // embedded: freed, the slot storage holds it
+    b->fill = (b->fill + 1) % b->size;
+  }
+  else {
+    b->bigmatrix[b->fill] = value;                  // Store the matrix pointer at the current fill position in the buffer
+    b->fill = (b->fill + 1) % b->size;  // Advance fill index with wrap-around when reaching buffer end
+  }
+  b->count++;                                  // Increment the count of items currently in the buffer
+  b->matrix_count++;                           // Increment the total count of matrices processed so far
+  instr_occupancy(b->count, b->size);
+  if (bytes > 0)
+    MemoryMove(MEM_PRODUCER, MEM_BUFFER, bytes);
   return EXIT_SUCCESS;                      // Return success code indicating proper insertion
 }
 
@@ -82,19 +367,93 @@ int put(Matrix * value)
  * 
  * Gets a matrix pointer from the buffer at the current use position,
  * updates use index with wrap-around, and decrements count.
+ * In priority order the highest priority matrix is taken instead.
  * Returns NULL if the buffer is empty.
  * 
  * @return Pointer to the retrieved Matrix, or NULL if buffer is empty
  */
-Matrix * get()
+Matrix * get(Buffer *b)
 {
-  if (count <= 0) {  // Check if buffer is empty
+  if (b->count <= 0) {  // Check if buffer is empty
     return NULL;     // Return NULL if there's nothing to retrieve
   }
-  Matrix *matrix = bigmatrix[use];       // Get the matrix at the current use position
-  use = (use + 1) % BOUNDED_BUFFER_SIZE; // Advance use index with wrap-around
-  count--;                               // Decrement the count of items in buffer
-  return matrix;                         // Return the retrieved matrix pointer
+  if (BUFFER_ORDER == BUFFER_PRIORITY)
+    return taken(b, unbuffered(heap_take(b, 0)));
+  Matrix *matrix = b->slots != NULL ? load_slot(b, b->use) : unbuffered(b->bigmatrix[b->use]);  // Get the matrix at the current use position
+  b->use = (b->use + 1) % b->size; // Advance use index with wrap-around
+  return taken(b, matrix);
+}
+
+/**
+ * @brief Retrieves a matrix to multiply with one of the given inner dimension
+ *
+ * In priority order, the highest priority buffered matrix with that many
+ * rows is taken if there is one, since the next matrix in priority order
+ * is rarely a compatible partner. Otherwise (and always in FIFO order)
+ * this is get().
+ *
+ * @param rows Columns of the left operand
+ * @return Pointer to the retrieved Matrix, or NULL if buffer is empty
+ */
+Matrix * get_match(Buffer *b, int rows)
+{
+  if (BUFFER_ORDER == BUFFER_PRIORITY) {
+    int best = -1;
+    for (int i = 0; i < b->count; i++)
+      if (b->bigmatrix[i]->rows == rows && (best < 0 || b->keys[i] > b->keys[best]))
+        best = i;
+    if (best >= 0)
+      return taken(b, unbuffered(heap_take(b, best)));
+  }
+  return get(b);
+}
+
+/**
+ * @brief Waits for matrices as a consumer, counting the time as idle
+ */
+static void consumer_wait(Buffer *b, ProdConsStats *stats)
+{
+  long long start = LatencyNow();
+  cond_wait(b, &b->full);
+  stats->idlens += LatencyNow() - start;
+}
+
+/**
+ * @brief Decides whether a product is computed, or only summed
+ *
+ * A product's elements are needed to display it, to pass it to the result
+ * callback, or to check it. With LAZY_PRODUCTS, other products are only
+ * summed with SumProduct(), and verification draws before the multiply so
+ * that only the products it samples are computed.
+ *
+ * @param sampled Set to 1 if the product was drawn for verification with seed,
+ *                0 if it was not, -1 if drawing is left to VerifyProduct()
+ * @param seed Set to the seed of the check when sampled is 1
+ * @return 1 to compute the product, 0 to only sum it
+ */
+static int materialize(Buffer *b, int *sampled, unsigned long long *seed)
+{
+  *sampled = -1;
+  *seed = 0;
+  if (!LAZY_PRODUCTS || SHOW_RESULTS || b->result != NULL)
+    return 1;
+  *sampled = VERIFY_RATE > 0 && VerifySample(seed);
+  return *sampled;
+}
+
+/**
+ * @brief Checks a computed product as materialize() drew it
+ */
+static void verify(Matrix **factors, int n, Matrix *product, int sampled, unsigned long long seed)
+{
+  if (VERIFY_RATE <= 0 || sampled == 0)
+    return;
+  long long traced = trace_begin();
+  if (sampled > 0)
+    VerifyCheck(factors, n, product, seed);
+  else
+    VerifyProduct(factors, n, product);
+  trace_end(TRACE_VERIFY, traced);
 }
 
 /**
@@ -102,54 +461,100 @@ Matrix * get()
  * Generates random matrices, calculates their element sum,
  * and places them into the shared buffer for consumers.
  * Continues until the required number of matrices have been produced.
+ * In input mode matrices are read from this producer's part of the input
+ * instead, parsed ahead of taking the lock, until the part is exhausted.
+ * A pipeline with a generator callback takes its matrices from it the
+ * same way, until it returns NULL.
  * 
- * @param arg Thread arguments (unused)
+ * @param arg Buffer of the pipeline (Buffer *)
  * @return Pointer to ProdConsStats containing producer thread statistics
  */
 void *prod_worker(void *arg)
 {
+  Buffer *b = (Buffer *)arg;
   // Initialize statistics tracking structure for this producer
+  if (MEMORY_STATS)
+    MemoryRole(MEM_PRODUCER);
   ProdConsStats *prodStats = (ProdConsStats *)malloc(sizeof(ProdConsStats));
   prodStats->matrixtotal = 0;
   prodStats->multtotal = 0;
   prodStats->sumtotal = 0;
+  prodStats->productsum = 0;
+  prodStats->chaincost = 0;
+  prodStats->naivecost = 0;
+  prodStats->idlens = 0;
+
+  // Part of the input read by this producer, and the matrix parsed from it next
+  InputCursor *cur = INPUT_PATH != NULL && b->generator == NULL ? InputClaim() : NULL;
+  Matrix *next = NULL;
   
   // Main production loop - continues until required number of matrices are produced
   while(1) {
+    // Parse the next input matrix, or ask the generator for it, before taking the lock
+    if ((b->generator != NULL || INPUT_PATH != NULL) && next == NULL) {
+      long long traced = trace_begin();
+      if (b->generator != NULL)
+        next = b->generator(b->user);
+      else
+        next = cur != NULL ? InputNext(cur) : NULL;
+      if (next == NULL)
+        break;  // the generator or this producer's part of the input is exhausted
+      if (SPARSE_DENSITY > 0)
+        next = ChooseStorage(next);
+      if (LATENCY)
+        next->born = LatencyNow();
+      trace_end(TRACE_GENERATE, traced);
+    }
+
     // Acquire mutex lock to safely access shared buffer
-    pthread_mutex_lock(&lock);
+    lock_buffer(b);
     
-    // Check if we've reached the target number of matrices
-    if (matrix_count >= NUMBER_OF_MATRICES) {
-      pthread_cond_signal(&empty);  // Signal any waiting producers
-      pthread_mutex_unlock(&lock);  // Release lock before exiting
+    // Check if we've reached the target number of matrices or were stopped
+    if (b->matrix_count >= b->matrices || b->stopping) {
+      cond_signal(&b->empty);  // Signal any waiting producers
+      unlock_buffer(b);  // Release lock before exiting
       break;
     }
     
     // Wait while buffer is full - producers must wait for consumers to free space
-    while(count == BOUNDED_BUFFER_SIZE) {
-      pthread_cond_wait(&empty, &lock);
+    while(b->count == b->size) {
+      cond_wait(b, &b->empty);
     }
     
     // Create and add a new matrix to the buffer if we haven't reached the limit
-    if (matrix_count < NUMBER_OF_MATRICES) {
-      Matrix *m = GenMatrixRandom();  // Generate a random matrix
+    if (b->matrix_count < b->matrices && !b->stopping) {
+      long long traced = trace_begin();
+      Matrix *m = next;
+      if (m == NULL) {
+        m = WORKLOAD_SPEC != NULL ? WorkloadMatrix() : GenMatrixRandom();  // Generate a random matrix
+        if (LATENCY)
+          m->born = LatencyNow();
+        trace_end(TRACE_GENERATE, traced);
+        traced = trace_begin();
+      }
+      next = NULL;
       prodStats->sumtotal += SumMatrix(m);  // Update sum statistics
-      put(m);  // Add matrix to the shared buffer
+      put(b, m);  // Add matrix to the shared buffer
+      trace_end(TRACE_PUT, traced);
       prodStats->matrixtotal++;  // Increment count of matrices produced
-      pthread_cond_signal(&full);  // Signal consumers that data is available
+      cond_signal(&b->full);  // Signal consumers that data is available
     }
     
     // Release mutex lock
-    pthread_mutex_unlock(&lock);
+    unlock_buffer(b);
   }
   
+  // An input matrix parsed after the target count was reached is not produced
+  if (next != NULL)
+    FreeMatrix(next);
+
   // Final cleanup - mark this producer as done and notify consumers
-  pthread_mutex_lock(&lock);
-  done++;  // Increment count of finished producers
-  pthread_cond_signal(&full);  // Signal consumers to check for completion
-  pthread_mutex_unlock(&lock);
+  lock_buffer(b);
+  b->done++;  // Increment count of finished producers
+  cond_signal(&b->full);  // Signal consumers to check for completion
+  unlock_buffer(b);
   
+  prodStats->endns = LatencyNow();
   return prodStats; // Return statistics about work done by this producer
 }
 
@@ -158,58 +563,72 @@ void *prod_worker(void *arg)
  * Retrieves matrices from the buffer, finds compatible pairs for multiplication,
  * performs the multiplication, and displays the results.
  * 
- * @param arg Thread arguments (unused)
+ * @param arg Buffer of the pipeline (Buffer *)
  * @return Pointer to ProdConsStats containing consumer thread statistics
  */
 void *cons_worker(void *arg)
 {
+  Buffer *b = (Buffer *)arg;
   // Initialize statistics tracking
+  if (MEMORY_STATS)
+    MemoryRole(MEM_CONSUMER);
   ProdConsStats *conStats = (ProdConsStats *)malloc(sizeof(ProdConsStats));
   conStats->matrixtotal = 0;
   conStats->multtotal = 0;
   conStats->sumtotal = 0;
+  conStats->productsum = 0;
+  conStats->chaincost = 0;
+  conStats->naivecost = 0;
+  conStats->idlens = 0;
   
   // Matrix pointers for multiplication operations
   Matrix *m1 = NULL, *m2 = NULL, *m3 = NULL;
+  int paired = 0;  // m1 and m2 are compatible; m3 is NULL if their product was only summed
   
   // Main processing loop
   while (1) {
-    pthread_mutex_lock(&lock);
+    lock_buffer(b);
     
     // Check if we're done (buffer empty and all producers finished)
-    if (count <= 0 && done >= numw) {
-      pthread_cond_signal(&full);  // Wake up any waiting consumers before unlocking
-      pthread_mutex_unlock(&lock); // Release the mutex lock before breaking
+    if (b->count <= 0 && b->done >= b->workers) {
+      cond_signal(&b->full);  // Wake up any waiting consumers before unlocking
+      unlock_buffer(b); // Release the mutex lock before breaking
       break;
     }
     
     // Wait for matrix if buffer is empty
-    while (count <= 0) {
+    while (b->count <= 0) {
       // Check again if we're done while waiting
-      if (done >= numw) {              // Check if all producer threads have finished
-        pthread_cond_signal(&full);    // Signal any waiting consumer threads to check completion status
-        pthread_mutex_unlock(&lock);   // Release the mutex lock before returning
+      if (b->done >= b->workers) {              // Check if all producer threads have finished
+        cond_signal(&b->full);    // Signal any waiting consumer threads to check completion status
+        unlock_buffer(b);   // Release the mutex lock before returning
+        conStats->endns = LatencyNow();
         return conStats;               // Return consumer statistics and exit the thread
       }
-      pthread_cond_wait(&full, &lock); // Wait for producers to add matrices to buffer (releases lock while waiting)
+      consumer_wait(b, conStats); // Wait for producers to add matrices to buffer (releases lock while waiting)
     }
     
     // Get first matrix for multiplication
-    m1 = get();
+    long long traced = trace_begin();
+    m1 = get(b);
+    trace_end(TRACE_GET, traced);
+    long long taken = LATENCY ? LatencyNow() : 0;  // start of this pair's latency
     if (m1 == NULL) {
-      pthread_mutex_unlock(&lock);
+      unlock_buffer(b);
       continue; // try again if we fail to get a matrix
     }
     
     // Update statistics
     conStats->sumtotal += SumMatrix(m1);
     conStats->matrixtotal++;
-    pthread_cond_signal(&empty);  // Signal space is available
+    cond_signal(&b->empty);  // Signal space is available
     
     // Find a compatible matrix for multiplication
-    while (m3 == NULL) {
+    int discarded = 0;  // incompatible matrices skipped for this m1
+    long long searching = trace_begin();
+    while (!paired) {
       // Check if we're done while searching for compatible matrix
-      if (count <= 0 && done >= numw) {
+      if (b->count <= 0 && b->done >= b->workers) {
         break;
       }
       
@@ -217,15 +636,18 @@ void *cons_worker(void *arg)
       if (m2 != NULL) {
         FreeMatrix(m2);
         m2 = NULL;
+        discarded++;
       }
       
       // Wait for more matrices if buffer is empty
-      while (count <= 0 && done != numw) {
-        pthread_cond_wait(&full, &lock);
+      while (b->count <= 0 && b->done != b->workers) {
+        consumer_wait(b, conStats);
       }
       
       // Get second matrix for multiplication
-      m2 = get();
+      traced = trace_begin();
+      m2 = get_match(b, m1->cols);
+      trace_end(TRACE_GET, traced);
       if (m2 == NULL) {
         continue;  // Try again if we couldn't get a matrix
       }
@@ -233,36 +655,658 @@ void *cons_worker(void *arg)
       // Update statistics
       conStats->sumtotal += SumMatrix(m2);
       conStats->matrixtotal++;
-      pthread_cond_signal(&empty);  // Signal space is available
+      cond_signal(&b->empty);  // Signal space is available
       
-      // Try to multiply matrices
-      m3 = MatrixMultiply(m1, m2);
-      // If m3 is NULL, matrices weren't compatible - loop will continue
+      // If matrices aren't compatible, the loop discards m2 and continues
+      if (m2->rows != m1->cols)
+        continue;
+      paired = 1;
     }
+    trace_end(TRACE_PAIR_SEARCH, searching);
     
-    // If we found compatible matrices, perform output
-    if (m3 != NULL) {
+    // If we found compatible matrices, multiply them (or sum their product) and perform output
+    if (paired) {
+      Matrix *pair[2] = { m1, m2 };
+      int sampled;
+      unsigned long long seed;
+      traced = trace_begin();
+      if (materialize(b, &sampled, &seed))
+        m3 = CACHE_SIZE > 0 ? CacheMultiply(m1, m2) : MatrixMultiply(m1, m2);
+      else
+        conStats->productsum += SumProduct(pair, 2);
+      trace_end(TRACE_MULTIPLY, traced);
+      if (m3 != NULL) {
+        conStats->productsum += SumMatrix(m3);
+        verify(pair, 2, m3, sampled, seed);
+      }
+      if (b->result != NULL)
+        b->result(pair, 2, m3, b->user);
       conStats->multtotal++;
+      __atomic_fetch_add(&b->multiplied_count, 1, __ATOMIC_RELAXED);
+      instr_discards(discarded);
       
       // Display the multiplication
-      DisplayMatrix(m1, stdout);
-      printf("    X\n");
-      DisplayMatrix(m2, stdout);
-      printf("    =\n");
-      DisplayMatrix(m3, stdout);
-      printf("\n");
-      fflush(NULL);
+      if (SHOW_RESULTS) {
+        traced = trace_begin();
+        DisplayMatrix(m1, stdout);
+        printf("    X\n");
+        DisplayMatrix(m2, stdout);
+        printf("    =\n");
+        DisplayMatrix(m3, stdout);
+        printf("\n");
+        fflush(NULL);
+        trace_end(TRACE_DISPLAY, traced);
+      }
+
+      // The product is done: record how long the pair and its operands took
+      if (LATENCY) {
+        LatencyRecord(LAT_PAIR, taken);
+        LatencyRecord(LAT_E2E, m1->born < m2->born ? m1->born : m2->born);
+      }
     }
     
     // Clean up matrices
+    traced = trace_begin();
     if (m1 != NULL) FreeMatrix(m1);
     if (m2 != NULL) FreeMatrix(m2);
     if (m3 != NULL) FreeMatrix(m3);
+    trace_end(TRACE_FREE, traced);
 
     // reset matrices again for next calculation
     m1 = m2 = m3 = NULL;
+    paired = 0;
     
-    pthread_mutex_unlock(&lock); // unlock after critical section
+    unlock_buffer(b); // unlock after critical section
+  }
+  conStats->endns = LatencyNow();
+  return conStats; // Return statistics about work done by this consumer
+}
+
+/**
+ * Matrix CHAIN CONSUMER worker thread
+ * Gathers a run of up to CHAIN_LENGTH mutually compatible matrices
+ * (A1: p0 x p1, A2: p1 x p2, ...) from the buffer, discarding incompatible
+ * ones, then multiplies the whole chain in the optimal order.
+ * The buffer lock is released while the chain is multiplied.
+ *
+ * @param arg Buffer of the pipeline (Buffer *)
+ * @return Pointer to ProdConsStats containing consumer thread statistics
+ */
+void *cons_chain_worker(void *arg)
+{
+  Buffer *b = (Buffer *)arg;
+  // Initialize statistics tracking
+  if (MEMORY_STATS)
+    MemoryRole(MEM_CONSUMER);
+  ProdConsStats *conStats = (ProdConsStats *)malloc(sizeof(ProdConsStats));
+  conStats->matrixtotal = 0;
+  conStats->multtotal = 0;
+  conStats->sumtotal = 0;
+  conStats->productsum = 0;
+  conStats->chaincost = 0;
+  conStats->naivecost = 0;
+  conStats->idlens = 0;
+
+  // Chain being gathered and scratch space for intermediate products
+  Matrix *chain[MAX_CHAIN];
+  long long taken = 0;  // when the chain's first matrix left the buffer
+  Arena scratch;
+  ArenaInit(&scratch);
+
+  while (1) {
+    lock_buffer(b);
+
+    // Gather a chain - the first matrix starts it, compatible ones extend it
+    int n = 0;
+    int discarded = 0;  // incompatible matrices skipped since the last link
+    long long searching = trace_begin();
+    while (n < CHAIN_LENGTH) {
+      while (b->count <= 0 && b->done < b->workers) {
+        consumer_wait(b, conStats);
+      }
+      if (b->count <= 0) {  // producers finished and buffer drained
+        break;
+      }
+      long long traced = trace_begin();
+      Matrix *m = n > 0 ? get_match(b, chain[n - 1]->cols) : get(b);
+      trace_end(TRACE_GET, traced);
+      conStats->sumtotal += SumMatrix(m);
+      conStats->matrixtotal++;
+      cond_signal(&b->empty);  // Signal space is available
+      if (n == 0 || chain[n - 1]->cols == m->rows) {
+        if (n > 0)
+          instr_discards(discarded);
+        else if (LATENCY)
+          taken = LatencyNow();
+        chain[n++] = m;
+        discarded = 0;
+      }
+      else {
+        FreeMatrix(m);  // incompatible with the chain, discard it
+        discarded++;
+      }
+    }
+
+    trace_end(TRACE_PAIR_SEARCH, searching);
+
+    // Nothing left to gather - wake other consumers so they can exit too
+    if (n == 0) {
+      cond_signal(&b->full);
+      unlock_buffer(b);
+      break;
+    }
+    unlock_buffer(b);
+
+    // Multiply the chain outside the lock; it is owned by this consumer only
+    if (n >= 2) {
+      Matrix *product = NULL;  // stays NULL if the chain's product is only summed
+      ChainPlan plan;
+      int sampled;
+      unsigned long long seed;
+      long long traced = trace_begin();
+      if (materialize(b, &sampled, &seed)) {
+        MatrixChainOrder(chain, n, &scratch, &plan);
+        product = MatrixChainMultiply(chain, &plan, &scratch);
+      }
+      else
+        conStats->productsum += SumProduct(chain, n);
+      trace_end(TRACE_MULTIPLY, traced);
+      if (product != NULL) {
+        conStats->productsum += SumMatrix(product);
+        conStats->chaincost += plan.cost;
+        conStats->naivecost += plan.naive;
+        verify(chain, n, product, sampled, seed);
+      }
+      if (b->result != NULL)
+        b->result(chain, n, product, b->user);
+      conStats->multtotal += n - 1;
+      __atomic_fetch_add(&b->multiplied_count, n - 1, __ATOMIC_RELAXED);
+
+      // Display the chain as one uninterrupted block of output
+      if (SHOW_RESULTS) {
+        traced = trace_begin();
+        flockfile(stdout);
+        printf("MULTIPLY CHAIN (%d x %d)", chain[0]->rows, chain[0]->cols);
+        for (int i = 1; i < n; i++) {
+          printf(" BY (%d x %d)", chain[i]->rows, chain[i]->cols);
+        }
+        printf(" AS ");
+        DisplayChainOrder(&plan, stdout);
+        printf(":\n");
+        for (int i = 0; i < n; i++) {
+          if (i > 0)
+            printf("    X\n");
+          DisplayMatrix(chain[i], stdout);
+        }
+        printf("    =\n");
+        DisplayMatrix(product, stdout);
+        printf("\n");
+        fflush(stdout);
+        funlockfile(stdout);
+        trace_end(TRACE_DISPLAY, traced);
+      }
+
+      // The product is done: record how long the chain and its oldest link took
+      if (LATENCY) {
+        long long born = chain[0]->born;
+        for (int i = 1; i < n; i++)
+          if (chain[i]->born < born)
+            born = chain[i]->born;
+        LatencyRecord(LAT_PAIR, taken);
+        LatencyRecord(LAT_E2E, born);
+      }
+
+      if (product != NULL)
+        FreeMatrix(product);
+    }
+
+    // Clean up the chain and its intermediate products
+    long long traced = trace_begin();
+    for (int i = 0; i < n; i++) {
+      FreeMatrix(chain[i]);
+    }
+    ArenaReset(&scratch);
+    trace_end(TRACE_FREE, traced);
   }
+
+  ArenaDestroy(&scratch);
+  conStats->endns = LatencyNow();
+  return conStats; // Return statistics about work done by this consumer
+}
+
+/**
+ * @brief Product of one compatible pair, computed by one or more tasks
+ *
+ * A large dense product is computed in row blocks into m3, which the
+ * pairing consumer allocates; otherwise m3 is NULL until the single task
+ * of the job has multiplied the pair. A job completed with m3 NULL only
+ * sums its product (see materialize()).
+ */
+typedef struct mul_job {
+  Buffer *buffer;   /**< pipeline the pair came from */
+  Matrix *m1, *m2, *m3;
+  int parts;        /**< tasks of the job not finished yet */
+  int split;        /**< computed in row blocks */
+  long long taken;  /**< when m1 left the buffer, for LAT_PAIR */
+  int sampled;      /**< verification draw, as set by materialize() */
+  unsigned long long seed;
+} MulJob;
+
+/**
+ * @brief Rows lo to hi - 1 of a job's product
+ */
+typedef struct mul_task {
+  MulJob *job;
+  int lo, hi;
+} MulTask;
+
+/**
+ * @brief Creates the job of a compatible pair, with the verification draw left to VerifyProduct()
+ *
+ * @param m3 Product, if already computed
+ */
+static MulJob *new_job(Buffer *b, Matrix *m1, Matrix *m2, Matrix *m3, long long taken)
+{
+  MulJob *job = (MulJob *)malloc(sizeof(MulJob));
+  assert(job != NULL);
+  job->buffer = b;
+  job->m1 = m1;
+  job->m2 = m2;
+  job->m3 = m3;
+  job->parts = 0;
+  job->split = 0;
+  job->taken = taken;
+  job->sampled = -1;
+  job->seed = 0;
+  return job;
+}
+
+/**
+ * @brief Creates the job of a compatible pair and the task covering all of its rows
+ *
+ * @param split Compute the product in row blocks that can be stolen
+ * @param sampled Verification draw of the product, set by materialize()
+ * @param seed Seed of the check, set by materialize()
+ */
+static MulTask *new_task(Buffer *b, Matrix *m1, Matrix *m2, long long taken, int split,
+                         int sampled, unsigned long long seed)
+{
+  MulJob *job = new_job(b, m1, m2, split ? AllocMatrix(m1->rows, m2->cols) : NULL, taken);
+  MulTask *t = (MulTask *)malloc(sizeof(MulTask));
+  assert(t != NULL);
+  job->parts = 1;
+  job->split = split;
+  job->sampled = sampled;
+  job->seed = seed;
+  t->job = job;
+  t->lo = 0;
+  t->hi = m1->rows;
+  return t;
+}
+
+/**
+ * @brief Completes a job once its last task is done: output, statistics and cleanup
+ *
+ * @param header Print the MULTIPLY header, which MatrixMultiply() prints itself
+ */
+static void finish_job(MulJob *job, ProdConsStats *stats, int header)
+{
+  Buffer *b = job->buffer;
+  Matrix *pair[2] = { job->m1, job->m2 };
+  if (job->m3 == NULL) {
+    long long traced = trace_begin();
+    stats->productsum += SumProduct(pair, 2);
+    trace_end(TRACE_MULTIPLY, traced);
+  }
+  else {
+    stats->productsum += SumMatrix(job->m3);
+    verify(pair, 2, job->m3, job->sampled, job->seed);
+  }
+  if (b->result != NULL)
+    b->result(pair, 2, job->m3, b->user);
+  stats->multtotal++;
+  __atomic_fetch_add(&b->multiplied_count, 1, __ATOMIC_RELAXED);
+
+  // Display the multiplication as one uninterrupted block of output
+  if (SHOW_RESULTS) {
+    long long traced = trace_begin();
+    flockfile(stdout);
+    if (header)
+      printf("MULTIPLY (%d x %d) BY (%d x %d):\n", job->m1->rows, job->m1->cols, job->m2->rows, job->m2->cols);
+    DisplayMatrix(job->m1, stdout);
+    printf("    X\n");
+    DisplayMatrix(job->m2, stdout);
+    printf("    =\n");
+    DisplayMatrix(job->m3, stdout);
+    printf("\n");
+    fflush(stdout);
+    funlockfile(stdout);
+    trace_end(TRACE_DISPLAY, traced);
+  }
+
+  if (LATENCY) {
+    LatencyRecord(LAT_PAIR, job->taken);
+    LatencyRecord(LAT_E2E, job->m1->born < job->m2->born ? job->m1->born : job->m2->born);
+  }
+
+  long long traced = trace_begin();
+  FreeMatrix(job->m1);
+  FreeMatrix(job->m2);
+  if (job->m3 != NULL)
+    FreeMatrix(job->m3);
+  free(job);
+  trace_end(TRACE_FREE, traced);
+}
+
+/**
+ * @brief Runs a multiply task taken from a deque
+ *
+ * A row block costing more than STEAL_GRAIN is halved, and the upper half
+ * pushed on the caller's deque for idle consumers to steal, until the
+ * block the caller keeps is small enough. Whoever finishes the last block
+ * of a job completes it.
+ *
+ * @param t Task, freed here
+ * @param mine Deque of the calling consumer
+ * @param stats Statistics of the calling consumer
+ */
+static void run_task(MulTask *t, StealDeque *mine, ProdConsStats *stats)
+{
+  MulJob *job = t->job;
+  Buffer *b = job->buffer;
+  if (!job->split) {
+    // The whole product at once; MatrixMultiply prints its header with the results
+    if (SHOW_RESULTS)
+      flockfile(stdout);
+    long long traced = trace_begin();
+    job->m3 = CACHE_SIZE > 0 ? CacheMultiply(job->m1, job->m2) : MatrixMultiply(job->m1, job->m2);
+    trace_end(TRACE_MULTIPLY, traced);
+    finish_job(job, stats, 0);
+    if (SHOW_RESULTS)
+      funlockfile(stdout);
+    free(t);
+    return;
+  }
+
+  long long per_row = (long long)job->m1->cols * job->m2->cols;
+  while (t->hi - t->lo > 1 && (t->hi - t->lo) * per_row > STEAL_GRAIN) {
+    int mid = (t->lo + t->hi) / 2;
+    MulTask *half = (MulTask *)malloc(sizeof(MulTask));
+    assert(half != NULL);
+    half->job = job;
+    half->lo = mid;
+    half->hi = t->hi;
+    __atomic_fetch_add(&job->parts, 1, __ATOMIC_RELAXED);
+    if (StealPush(mine, half) != 0) {
+      __atomic_fetch_sub(&job->parts, 1, __ATOMIC_RELAXED);
+      free(half);
+      break;  // deque full, compute the rest here
+    }
+    t->hi = mid;  // half may already be stolen and freed
+
+    // Wake a consumer waiting for matrices, it can steal the half instead
+    lock_buffer(b);
+    cond_signal(&b->full);
+    unlock_buffer(b);
+  }
+
+  long long traced = trace_begin();
+  MatrixMultiplyRows(job->m1, job->m2, job->m3, t->lo, t->hi);
+  trace_end(TRACE_MULTIPLY, traced);
+  free(t);
+  if (__atomic_sub_fetch(&job->parts, 1, __ATOMIC_ACQ_REL) == 0)
+    finish_job(job, stats, 1);
+}
+
+/**
+ * @brief Consumer a batched pair is completed for, and its batches
+ */
+typedef struct batch_owner {
+  Buffer *buffer;
+  ProdConsStats *stats;
+  Batch *batch;
+} BatchOwner;
+
+/**
+ * @brief Completes a pair multiplied in a batch; the BatchDone of cons_batch_worker
+ *
+ * @param arg BatchOwner of the calling consumer
+ */
+static void batch_done(Matrix *m1, Matrix *m2, Matrix *product, long long taken, void *arg)
+{
+  BatchOwner *owner = (BatchOwner *)arg;
+  finish_job(new_job(owner->buffer, m1, m2, product, taken), owner->stats, 1);
+}
+
+/**
+ * @brief Multiplies a consumer's partly filled batches rather than let them wait with it
+ *
+ * Called with the buffer lock held; releases it while multiplying.
+ */
+static void flush_batches(Buffer *b, BatchOwner *owner)
+{
+  unlock_buffer(b);
+  long long traced = trace_begin();
+  BatchFlush(owner->batch, batch_done, owner);
+  trace_end(TRACE_MULTIPLY, traced);
+  lock_buffer(b);
+}
+
+/**
+ * @brief Takes a matrix and the next compatible one from the buffer
+ *
+ * Incompatible matrices are discarded, as cons_worker does. Called with
+ * the buffer lock held and a matrix in the buffer; returns with the lock
+ * released.
+ *
+ * @param stats Statistics of the calling consumer
+ * @param m1 Set to the left operand
+ * @param m2 Set to the right operand
+ * @param taken Set to when m1 left the buffer, if LATENCY is set
+ * @param owner Batches of the calling consumer, flushed before it waits, or NULL
+ * @return 0 on success, -1 if the buffer ran out before a partner for m1 (which is freed)
+ */
+static int take_pair(Buffer *b, ProdConsStats *stats, Matrix **m1, Matrix **m2, long long *taken,
+                     BatchOwner *owner)
+{
+  // Get first matrix for multiplication
+  long long traced = trace_begin();
+  *m1 = get(b);
+  trace_end(TRACE_GET, traced);
+  *taken = LATENCY ? LatencyNow() : 0;  // start of this pair's latency
+  stats->sumtotal += SumMatrix(*m1);
+  stats->matrixtotal++;
+  cond_signal(&b->empty);  // Signal space is available
+
+  // Find a compatible matrix, discarding incompatible ones
+  *m2 = NULL;
+  int discarded = 0;
+  long long searching = trace_begin();
+  while (1) {
+    while (b->count <= 0 && b->done < b->workers) {
+      if (owner != NULL && BatchPending(owner->batch) > 0)
+        flush_batches(b, owner);  // the buffer may have changed meanwhile
+      else
+        consumer_wait(b, stats);
+    }
+    if (b->count <= 0) {
+      break;  // producers finished and buffer drained
+    }
+    traced = trace_begin();
+    *m2 = get_match(b, (*m1)->cols);
+    trace_end(TRACE_GET, traced);
+    stats->sumtotal += SumMatrix(*m2);
+    stats->matrixtotal++;
+    cond_signal(&b->empty);  // Signal space is available
+    if ((*m2)->rows == (*m1)->cols)
+      break;
+    FreeMatrix(*m2);
+    *m2 = NULL;
+    discarded++;
+  }
+  trace_end(TRACE_PAIR_SEARCH, searching);
+  unlock_buffer(b);
+
+  if (*m2 == NULL) {
+    FreeMatrix(*m1);
+    return -1;
+  }
+  instr_discards(discarded);
+  return 0;
+}
+
+/**
+ * Matrix WORK-STEALING CONSUMER worker thread
+ * Pairs matrices like cons_worker, but hands each compatible pair to its
+ * own deque as a multiply task instead of multiplying it under the buffer
+ * lock. Consumers run their own tasks first, then steal from the others
+ * before pairing again, so the products of one consumer's pairs spread
+ * over every consumer that would otherwise be idle.
+ *
+ * @param arg Buffer of the pipeline (Buffer *)
+ * @return Pointer to ProdConsStats containing consumer thread statistics
+ */
+void *cons_steal_worker(void *arg)
+{
+  Buffer *b = (Buffer *)arg;
+  // Initialize statistics tracking
+  if (MEMORY_STATS)
+    MemoryRole(MEM_CONSUMER);
+  ProdConsStats *conStats = (ProdConsStats *)malloc(sizeof(ProdConsStats));
+  conStats->matrixtotal = 0;
+  conStats->multtotal = 0;
+  conStats->sumtotal = 0;
+  conStats->productsum = 0;
+  conStats->chaincost = 0;
+  conStats->naivecost = 0;
+  conStats->idlens = 0;
+
+  StealDeque *mine = StealJoin(b->steal);
+
+  while (1) {
+    // Own tasks first, then the other consumers' tasks
+    MulTask *t = (MulTask *)StealPop(mine);
+    if (t == NULL)
+      t = (MulTask *)StealFrom(mine);
+    if (t != NULL) {
+      run_task(t, mine, conStats);
+      continue;
+    }
+
+    lock_buffer(b);
+
+    // Wait for matrices, or for tasks to steal
+    while (b->count <= 0 && b->done < b->workers && StealPending(b->steal) == 0) {
+      consumer_wait(b, conStats);
+    }
+    if (b->count <= 0) {
+      if (b->done >= b->workers && StealPending(b->steal) == 0) {  // nothing left anywhere
+        cond_signal(&b->full);  // Wake up any waiting consumers before unlocking
+        unlock_buffer(b);
+        break;
+      }
+      unlock_buffer(b);
+      continue;  // go steal
+    }
+
+    Matrix *m1, *m2;
+    long long taken;
+    if (take_pair(b, conStats, &m1, &m2, &taken, NULL) != 0)
+      continue;  // no partner left for m1
+
+    // A product that is only summed is no work worth sharing
+    int sampled;
+    unsigned long long seed;
+    if (!materialize(b, &sampled, &seed)) {
+      finish_job(new_job(b, m1, m2, NULL, taken), conStats, 0);
+      continue;
+    }
+
+    // Large dense products are computed in row blocks that can be stolen
+    int split = m1->csr == NULL && m2->csr == NULL && m1->rows > 1 &&
+                (long long)m1->rows * m1->cols * m2->cols > STEAL_GRAIN;
+    t = new_task(b, m1, m2, taken, split, sampled, seed);
+    if (StealPush(mine, t) != 0)
+      run_task(t, mine, conStats);
+  }
+  conStats->endns = LatencyNow();
+  return conStats; // Return statistics about work done by this consumer
+}
+
+/**
+ * Matrix BATCHING CONSUMER worker thread
+ * Pairs matrices like cons_worker, then multiplies small dense pairs in
+ * batches of BATCH_SIZE pairs of the same shape (see batch.h) outside the
+ * buffer lock. Other pairs are multiplied one at a time, also outside the
+ * lock. Partly filled batches are multiplied once the buffer is drained.
+ *
+ * @param arg Buffer of the pipeline (Buffer *)
+ * @return Pointer to ProdConsStats containing consumer thread statistics
+ */
+void *cons_batch_worker(void *arg)
+{
+  Buffer *b = (Buffer *)arg;
+  // Initialize statistics tracking
+  if (MEMORY_STATS)
+    MemoryRole(MEM_CONSUMER);
+  ProdConsStats *conStats = (ProdConsStats *)malloc(sizeof(ProdConsStats));
+  conStats->matrixtotal = 0;
+  conStats->multtotal = 0;
+  conStats->sumtotal = 0;
+  conStats->productsum = 0;
+  conStats->chaincost = 0;
+  conStats->naivecost = 0;
+  conStats->idlens = 0;
+
+  Batch *batch = BatchCreate(BATCH_SIZE);
+  BatchOwner owner = { b, conStats, batch };
+
+  while (1) {
+    // Pairs that waited too long in partly filled batches are multiplied as they are
+    long long traced = trace_begin();
+    BatchExpire(batch, batch_done, &owner);
+    trace_end(TRACE_MULTIPLY, traced);
+
+    lock_buffer(b);
+
+    // Wait for matrices, flushing the batches first; stop once producers finished and buffer drained
+    while (b->count <= 0 && b->done < b->workers) {
+      if (BatchPending(batch) > 0)
+        flush_batches(b, &owner);
+      else
+        consumer_wait(b, conStats);
+    }
+    if (b->count <= 0) {
+      cond_signal(&b->full);  // Wake up any waiting consumers before unlocking
+      unlock_buffer(b);
+      break;
+    }
+
+    Matrix *m1, *m2;
+    long long taken;
+    if (take_pair(b, conStats, &m1, &m2, &taken, &owner) != 0)
+      continue;  // no partner left for m1
+
+    // Products drawn for verification ahead of the multiply are checked one at a time
+    int sampled;
+    unsigned long long seed;
+    if (!materialize(b, &sampled, &seed)) {
+      finish_job(new_job(b, m1, m2, NULL, taken), conStats, 0);
+    }
+    else if (sampled < 0 && BatchFits(m1, m2)) {
+      long long traced = trace_begin();
+      BatchAdd(batch, m1, m2, taken, batch_done, &owner);
+      trace_end(TRACE_MULTIPLY, traced);
+    }
+    else {
+      run_task(new_task(b, m1, m2, taken, 0, sampled, seed), NULL, conStats);
+    }
+  }
+
+  long long traced = trace_begin();
+  BatchFlush(batch, batch_done, &owner);
+  trace_end(TRACE_MULTIPLY, traced);
+  BatchDestroy(batch);
+  conStats->endns = LatencyNow();
   return conStats; // Return statistics about work done by this consumer
 }
@@ -6,24 +6,101 @@
  *  TCSS 422 - Operating Systems
  */
 
-Matrix ** bigmatrix;
+// Callbacks through which a pipeline's user supplies matrices and receives products
+// generator - returns the next matrix to produce, or NULL when it has no more;
+//             called by producers concurrently, without the buffer lock
+// result    - receives every product with its factors (two for a pair, the
+//             whole chain in chain mode); called by consumers concurrently.
+//             The matrices belong to the pipeline and are freed on return.
+typedef Matrix * (*MatrixGenerator)(void *user);
+typedef void (*ProductResult)(Matrix **factors, int n, Matrix *product, void *user);
+
+/**
+ * @brief Condition shared by thread and task execution modes.
+ * Threads wait on the pthread condition variable; cooperative tasks
+ * (EXEC_MODE == EXEC_TASKS) park on the task queue instead.
+ */
+typedef struct pc_cond {
+  pthread_cond_t cv;
+  coop_cond_t tasks;
+} pc_cond_t;
+
+struct steal_set;
+
+// Bounded buffer of one pipeline and the state of the run using it; its
+// producers and consumers get a pointer to it as their argument
+// bigmatrix       - matrices in the buffer (or slots, see INLINE_MAX)
+// size            - capacity of the buffer
+// matrices        - matrices to produce
+// workers         - producers, and consumers
+// fill/use/count  - ring positions and number of buffered matrices
+// matrix_count    - matrices put so far
+// done            - producers finished
+// stopping        - set by StopProducers() to end production early
+// multiplied_count - multiplications completed, read by progress reports
+// keys/put_seq    - priority buffer (BUFFER_PRIORITY) heap keys and aging clock
+// slots/slot_size - slots embedding small matrices (INLINE_MAX)
+// steal           - work-stealing deques (WORK_STEALING), or NULL
+typedef struct buffer {
+  Matrix ** bigmatrix;
+  int size;
+  int matrices;
+  int workers;
+  int fill;
+  int use;
+  int count;
+  int matrix_count;
+  int done;
+  int stopping;
+  long long multiplied_count;
+  pthread_mutex_t lock;
+  pc_cond_t full;
+  pc_cond_t empty;
+  double * keys;
+  long long put_seq;
+  char * slots;
+  size_t slot_size;
+  struct steal_set * steal;
+  MatrixGenerator generator;
+  ProductResult result;
+  void * user;
+} Buffer;
 
 // PRODUCER-CONSUMER put() get() function prototypes
 
 // Data structure to track matrix production / consumption stats
 // sumtotal - total of all elements produced or consumed
+// productsum - total of all elements of the products (computed or lazy)
 // multtotal - total number of matrices multipled
 // matrixtotal - total number of matrces produced or consumed
+// chaincost - scalar multiplications performed by chain consumers
+// naivecost - scalar multiplications a left-to-right order would have needed
+// idlens - nanoseconds a consumer spent waiting for matrices
+// endns - CLOCK_MONOTONIC nanoseconds when the worker finished
 typedef struct prodcons {
   int sumtotal;
+  int productsum;
   int multtotal;
   int matrixtotal;
+  long long chaincost;
+  long long naivecost;
+  long long idlens;
+  long long endns;
 } ProdConsStats;
 
 // PRODUCER-CONSUMER thread method function prototypes
 void *prod_worker(void *arg);
 void *cons_worker(void *arg);
+void *cons_chain_worker(void *arg);
+void *cons_steal_worker(void *arg);
+void *cons_batch_worker(void *arg);
 
 // Routines to add and remove matrices from the bounded buffer
-int put(Matrix *value);
-Matrix * get();
+void InitBuffer(Buffer *b);
+void ResetBuffer(Buffer *b);
+void DestroyBuffer(Buffer *b);
+void StopProducers(Buffer *b);
+void BufferProgress(Buffer *b, int *produced, int *consumed, long long *multiplied);
+int put(Buffer *b, Matrix *value);
+Matrix * get(Buffer *b);
+Matrix * get_match(Buffer *b, int rows);
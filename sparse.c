@@ -0,0 +1,296 @@
+/*
+ *  Sparse matrix routines
+ *  CSR storage, conversions and sparse multiply kernels
+ *
+ *  A matrix in CSR form keeps only its nonzero elements, row by row.
+ *  ChooseStorage() measures a matrix's density and moves it to whichever
+ *  form suits it; MatrixMultiply() sends any product with a CSR operand
+ *  here, where sparse x dense and dense x sparse products only touch the
+ *  stored elements and sparse x sparse products are built row by row
+ *  (Gustavson's algorithm) without ever materializing a dense matrix.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "sparse.h"
+#include "memory.h"
+#include "pcmatrix.h"
+
+/**
+ * @file sparse.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Allocates an r x c CSR matrix with room for nnz elements
+ *
+ * The header, row pointers, column indices and values share one block.
+ *
+ * @return Matrix with csr set and m NULL; rowptr[0] is 0, the rest is uninitialized
+ */
+Matrix *AllocSparseMatrix(int r, int c, int nnz)
+{
+  Matrix *mat = (Matrix *)malloc(sizeof(Matrix) + sizeof(Csr) + sizeof(int) * ((size_t)r + 1 + 2 * (size_t)nnz));
+  assert(mat != NULL);
+  Csr *s = (Csr *)(mat + 1);
+  s->nnz = nnz;
+  s->rowptr = (int *)(s + 1);
+  s->colidx = s->rowptr + r + 1;
+  s->vals = s->colidx + nnz;
+  s->rowptr[0] = 0;
+  mat->m = NULL;
+  mat->rows = r;
+  mat->cols = c;
+  mat->storage = MATRIX_HEAP;
+  mat->csr = s;
+  if (MEMORY_STATS)
+    MemoryAlloc(MatrixBytes(mat));
+  return mat;
+}
+
+/**
+ * @brief Copies a dense matrix into CSR form
+ */
+Matrix *DenseToSparse(Matrix *mat)
+{
+  int nnz = 0;
+  for (int i = 0; i < mat->rows; i++)
+    for (int j = 0; j < mat->cols; j++)
+      nnz += mat->m[i][j] != 0;
+  Matrix *sp = AllocSparseMatrix(mat->rows, mat->cols, nnz);
+  Csr *s = sp->csr;
+  int k = 0;
+  for (int i = 0; i < mat->rows; i++) {
+    for (int j = 0; j < mat->cols; j++) {
+      if (mat->m[i][j] != 0) {
+        s->colidx[k] = j;
+        s->vals[k++] = mat->m[i][j];
+      }
+    }
+    s->rowptr[i + 1] = k;
+  }
+  return sp;
+}
+
+/**
+ * @brief Copies a CSR matrix into a dense one from AllocMatrix()
+ */
+Matrix *SparseToDense(Matrix *mat)
+{
+  Matrix *d = AllocMatrix(mat->rows, mat->cols);
+  for (int i = 0; i < mat->rows; i++)
+    MatrixRow(mat, i, d->m[i]);
+  return d;
+}
+
+/**
+ * @brief Stores a matrix densely or in CSR according to its measured density
+ *
+ * Matrices with at most SPARSE_MAX_DENSITY percent nonzeros go to CSR, the
+ * rest stay or become dense. Arena matrices are returned unchanged; a view
+ * is copied into CSR, which leaves the storage it borrowed untouched.
+ *
+ * @param mat Matrix to place; freed if it is converted
+ * @return mat itself, or its converted replacement
+ */
+Matrix *ChooseStorage(Matrix *mat)
+{
+  long long elems = (long long)mat->rows * mat->cols;
+  if (mat->csr != NULL) {
+    if (mat->csr->nnz * 100LL <= elems * SPARSE_MAX_DENSITY)
+      return mat;
+    Matrix *d = SparseToDense(mat);
+    FreeMatrix(mat);
+    return d;
+  }
+  if (mat->storage == MATRIX_ARENA)
+    return mat;
+  // Stop counting as soon as the matrix is known to be too dense
+  long long limit = elems * SPARSE_MAX_DENSITY / 100;
+  long long nnz = 0;
+  for (int i = 0; i < mat->rows && nnz <= limit; i++)
+    for (int j = 0; j < mat->cols; j++)
+      nnz += mat->m[i][j] != 0;
+  if (nnz > limit)
+    return mat;
+  Matrix *sp = DenseToSparse(mat);
+  FreeMatrix(mat);
+  return sp;
+}
+
+/**
+ * @brief Multiplies CSR by CSR into a new CSR matrix (Gustavson's algorithm)
+ *
+ * Each output row is accumulated in a dense scratch row, touching only
+ * the rows of m2 selected by the nonzeros of the matching m1 row.
+ */
+static Matrix *sparse_sparse(Matrix *m1, Matrix *m2)
+{
+  Csr *a = m1->csr, *b = m2->csr;
+  int cols = m2->cols;
+  int *acc = (int *)calloc(cols, sizeof(int));
+  char *seen = (char *)calloc(cols, 1);
+  int *touched = (int *)malloc(sizeof(int) * cols);
+  int *rowptr = (int *)malloc(sizeof(int) * ((size_t)m1->rows + 1));
+  int cap = a->nnz + b->nnz + 1;
+  int *colidx = (int *)malloc(sizeof(int) * cap);
+  int *vals = (int *)malloc(sizeof(int) * cap);
+  assert(acc && seen && touched && rowptr && colidx && vals);
+
+  int nnz = 0;
+  rowptr[0] = 0;
+  for (int i = 0; i < m1->rows; i++) {
+    int ntouched = 0;
+    for (int p = a->rowptr[i]; p < a->rowptr[i + 1]; p++) {
+      int k = a->colidx[p], v = a->vals[p];
+      for (int q = b->rowptr[k]; q < b->rowptr[k + 1]; q++) {
+        int j = b->colidx[q];
+        if (!seen[j]) {
+          seen[j] = 1;
+          touched[ntouched++] = j;
+        }
+        acc[j] += v * b->vals[q];
+      }
+    }
+    // Emit the row in column order, dropping sums that cancelled to zero
+    if (nnz + ntouched > cap) {
+      cap = 2 * (nnz + ntouched);
+      colidx = (int *)realloc(colidx, sizeof(int) * cap);
+      vals = (int *)realloc(vals, sizeof(int) * cap);
+      assert(colidx && vals);
+    }
+    if (ntouched * 8 < cols) {
+      // few columns: sort the touched list
+      for (int x = 1; x < ntouched; x++)
+        for (int y = x; y > 0 && touched[y - 1] > touched[y]; y--) {
+          int t = touched[y]; touched[y] = touched[y - 1]; touched[y - 1] = t;
+        }
+      for (int x = 0; x < ntouched; x++) {
+        int j = touched[x];
+        if (acc[j] != 0) {
+          colidx[nnz] = j;
+          vals[nnz++] = acc[j];
+        }
+        acc[j] = 0;
+        seen[j] = 0;
+      }
+    }
+    else {
+      // many columns: a scan of the scratch row is already in order
+      for (int j = 0; j < cols; j++) {
+        if (seen[j]) {
+          if (acc[j] != 0) {
+            colidx[nnz] = j;
+            vals[nnz++] = acc[j];
+          }
+          acc[j] = 0;
+          seen[j] = 0;
+        }
+      }
+    }
+    rowptr[i + 1] = nnz;
+  }
+
+  Matrix *out = AllocSparseMatrix(m1->rows, cols, nnz);
+  memcpy(out->csr->rowptr, rowptr, sizeof(int) * ((size_t)m1->rows + 1));
+  memcpy(out->csr->colidx, colidx, sizeof(int) * nnz);
+  memcpy(out->csr->vals, vals, sizeof(int) * nnz);
+  free(acc);
+  free(seen);
+  free(touched);
+  free(rowptr);
+  free(colidx);
+  free(vals);
+  return out;
+}
+
+/**
+ * @brief Multiplies two compatible matrices when at least one is in CSR
+ *
+ * @return Product stored densely or in CSR according to its density
+ */
+Matrix *SparseMultiply(Matrix *m1, Matrix *m2)
+{
+  Matrix *out;
+  if (m1->csr != NULL && m2->csr != NULL) {
+    out = sparse_sparse(m1, m2);
+  }
+  else {
+    out = AllocMatrix(m1->rows, m2->cols);
+    SparseMultiplyInto(m1, m2, out);
+  }
+  return ChooseStorage(out);
+}
+
+/**
+ * @brief Multiplies into a preallocated dense (m1->rows x m2->cols) matrix
+ *
+ * Handles every combination of dense and CSR operands; only the stored
+ * elements of CSR operands are visited.
+ */
+void SparseMultiplyInto(Matrix *m1, Matrix *m2, Matrix *out)
+{
+  int **nm = out->m;
+  for (int i = 0; i < out->rows; i++)
+    memset(nm[i], 0, sizeof(int) * out->cols);
+
+  if (m1->csr != NULL && m2->csr != NULL) {
+    Csr *a = m1->csr, *b = m2->csr;
+    for (int i = 0; i < m1->rows; i++)
+      for (int p = a->rowptr[i]; p < a->rowptr[i + 1]; p++)
+        for (int q = b->rowptr[a->colidx[p]]; q < b->rowptr[a->colidx[p] + 1]; q++)
+          nm[i][b->colidx[q]] += a->vals[p] * b->vals[q];
+  }
+  else if (m1->csr != NULL) {
+    // sparse x dense: each stored a(i,k) scales row k of m2 into row i
+    Csr *a = m1->csr;
+    for (int i = 0; i < m1->rows; i++) {
+      int *row = nm[i];
+      for (int p = a->rowptr[i]; p < a->rowptr[i + 1]; p++) {
+        int v = a->vals[p];
+        int *brow = m2->m[a->colidx[p]];
+        for (int j = 0; j < out->cols; j++)
+          row[j] += v * brow[j];
+      }
+    }
+  }
+  else {
+    // dense x sparse: each a(i,k) scales the stored elements of row k of m2
+    Csr *b = m2->csr;
+    for (int i = 0; i < m1->rows; i++) {
+      int *row = nm[i];
+      int *arow = m1->m[i];
+      for (int k = 0; k < m1->cols; k++) {
+        int v = arow[k];
+        if (v == 0)
+          continue;
+        for (int q = b->rowptr[k]; q < b->rowptr[k + 1]; q++)
+          row[b->colidx[q]] += v * b->vals[q];
+      }
+    }
+  }
+}
+
+/**
+ * @brief Copies row i of a dense or CSR matrix into row[0 .. cols-1]
+ */
+void MatrixRow(Matrix *mat, int i, int *row)
+{
+  if (mat->csr == NULL) {
+    memcpy(row, mat->m[i], sizeof(int) * mat->cols);
+    return;
+  }
+  Csr *s = mat->csr;
+  memset(row, 0, sizeof(int) * mat->cols);
+  for (int p = s->rowptr[i]; p < s->rowptr[i + 1]; p++)
+    row[s->colidx[p]] = s->vals[p];
+}
@@ -0,0 +1,34 @@
+/*
+ *  sparse header
+ *  Function prototypes, data, and constants for sparse matrix module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// SPARSE MATRICES (compressed sparse row storage)
+
+// Matrices with at most this percent of nonzero elements are stored in CSR.
+// CSR keeps a column index next to every value, so above this density the
+// dense kernels win on both memory traffic and flops.
+#define SPARSE_MAX_DENSITY 30
+
+// Row i holds vals[rowptr[i] .. rowptr[i+1]-1] in columns colidx[...],
+// sorted by column; zeros are never stored
+typedef struct csr {
+  int nnz;
+  int * rowptr;
+  int * colidx;
+  int * vals;
+} Csr;
+
+struct matrix;
+
+// sparse methods
+struct matrix * AllocSparseMatrix(int r, int c, int nnz);
+struct matrix * DenseToSparse(struct matrix *mat);
+struct matrix * SparseToDense(struct matrix *mat);
+struct matrix * ChooseStorage(struct matrix *mat);
+struct matrix * SparseMultiply(struct matrix *m1, struct matrix *m2);
+void SparseMultiplyInto(struct matrix *m1, struct matrix *m2, struct matrix *out);
+void MatrixRow(struct matrix *mat, int i, int *row);
@@ -0,0 +1,182 @@
+/*
+ *  Work-stealing deque routines
+ *  Chase-Lev deques through which consumers share multiply tasks
+ *
+ *  Every consumer owns one deque. It pushes and pops tasks at the bottom
+ *  without taking a lock; idle consumers steal from the top of the other
+ *  deques, and only a thief racing the owner for the last task needs a
+ *  compare-and-swap. Based on "Correct and Efficient Work-Stealing for
+ *  Weak Memory Models" (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013),
+ *  with a fixed-size ring instead of a growable one.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "steal.h"
+
+/**
+ * @file steal.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Deque of one consumer
+ *
+ * top and bottom sit on their own cache lines: thieves write top,
+ * the owner writes bottom.
+ */
+struct steal_deque {
+  long top __attribute__((aligned(64)));     /**< next task a thief takes */
+  long bottom __attribute__((aligned(64)));  /**< next free slot of the owner */
+  StealSet *set;                             /**< set the deque belongs to */
+  void *slots[STEAL_DEQUE_SIZE];
+};
+
+/**
+ * @brief Creates one empty deque per consumer
+ *
+ * @param nconsumers Consumers that will call StealJoin()
+ * @return Set of deques, released with StealDestroy()
+ */
+StealSet *StealInit(int nconsumers)
+{
+  StealSet *set = (StealSet *)calloc(1, sizeof(StealSet));
+  assert(set != NULL);
+  set->deques = (StealDeque *)aligned_alloc(64, sizeof(StealDeque) * nconsumers);
+  assert(set->deques != NULL);
+  for (int i = 0; i < nconsumers; i++) {
+    set->deques[i].top = 0;
+    set->deques[i].bottom = 0;
+    set->deques[i].set = set;
+  }
+  set->n = nconsumers;
+  return set;
+}
+
+/**
+ * @brief Hands the calling consumer a deque of its own
+ */
+StealDeque *StealJoin(StealSet *set)
+{
+  int i = __atomic_fetch_add(&set->joined, 1, __ATOMIC_RELAXED);
+  assert(i < set->n);
+  return &set->deques[i];
+}
+
+/**
+ * @brief Pushes a task on the bottom of the owner's deque
+ *
+ * @param q Deque of the calling consumer
+ * @param task Task to push
+ * @return 0 on success, -1 if the deque is full
+ */
+int StealPush(StealDeque *q, void *task)
+{
+  long b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+  if (b - t >= STEAL_DEQUE_SIZE)
+    return -1;
+  // Counted before it can be taken, so StealPending() never misses it
+  __atomic_fetch_add(&q->set->pending, 1, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&q->set->pushed, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&q->slots[b % STEAL_DEQUE_SIZE], task, __ATOMIC_RELAXED);
+  __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/**
+ * @brief Pops the most recently pushed task of the owner's deque
+ *
+ * @param q Deque of the calling consumer
+ * @return Task, or NULL if the deque is empty
+ */
+void *StealPop(StealDeque *q)
+{
+  long b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - 1;
+  // Sequentially consistent, so a thief cannot miss the claim on the bottom task
+  __atomic_store_n(&q->bottom, b, __ATOMIC_SEQ_CST);
+  long t = __atomic_load_n(&q->top, __ATOMIC_SEQ_CST);
+  void *task = NULL;
+  if (t <= b) {
+    task = __atomic_load_n(&q->slots[b % STEAL_DEQUE_SIZE], __ATOMIC_RELAXED);
+    if (t == b) {
+      // The last task: a thief may be taking it at the same time
+      if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        task = NULL;
+      __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  }
+  else {
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  if (task != NULL)
+    __atomic_fetch_sub(&q->set->pending, 1, __ATOMIC_SEQ_CST);
+  return task;
+}
+
+/**
+ * @brief Takes the oldest task of another consumer's deque
+ *
+ * @param q Deque to steal from
+ * @return Task, or NULL if the deque was empty or another thread won the race
+ */
+static void *steal(StealDeque *q)
+{
+  long t = __atomic_load_n(&q->top, __ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&q->bottom, __ATOMIC_SEQ_CST);
+  if (t >= b)
+    return NULL;
+  void *task = __atomic_load_n(&q->slots[t % STEAL_DEQUE_SIZE], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return NULL;
+  __atomic_fetch_sub(&q->set->pending, 1, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&q->set->stolen, 1, __ATOMIC_RELAXED);
+  return task;
+}
+
+/**
+ * @brief Tries to steal a task from each other consumer once
+ *
+ * Victims are visited starting after the caller's own deque, so thieves
+ * spread over different victims.
+ *
+ * @param self Deque of the calling consumer, which is skipped
+ * @return Task, or NULL if nothing could be stolen
+ */
+void *StealFrom(StealDeque *self)
+{
+  StealSet *set = self->set;
+  int me = (int)(self - set->deques);
+  for (int i = 1; i < set->n; i++) {
+    void *task = steal(&set->deques[(me + i) % set->n]);
+    if (task != NULL)
+      return task;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Tasks waiting in some deque
+ */
+long StealPending(StealSet *set)
+{
+  return __atomic_load_n(&set->pending, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Releases a set of deques
+ */
+void StealDestroy(StealSet *set)
+{
+  if (set == NULL)
+    return;
+  free(set->deques);
+  free(set);
+}
@@ -0,0 +1,36 @@
+/*
+ *  steal header
+ *  Function prototypes, data, and constants for work-stealing deque module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// WORK-STEALING DEQUES (Chase-Lev, one per consumer)
+
+// Tasks one deque holds; a full deque makes StealPush() fail
+#define STEAL_DEQUE_SIZE 1024
+
+// Multiply-adds below which a product is not split into row blocks
+#define STEAL_GRAIN (1 << 16)
+
+typedef struct steal_deque StealDeque;
+
+// Deques of the consumers of one pipeline, and their task counters
+typedef struct steal_set {
+  StealDeque * deques;
+  int n;
+  int joined;    // deques handed out by StealJoin()
+  long pending;  // tasks pushed and not yet popped or stolen
+  long pushed;   // totals of the run
+  long stolen;
+} StealSet;
+
+// deque methods
+StealSet * StealInit(int nconsumers);
+StealDeque * StealJoin(StealSet *set);
+int StealPush(StealDeque *q, void *task);
+void * StealPop(StealDeque *q);
+void * StealFrom(StealDeque *self);
+long StealPending(StealSet *set);
+void StealDestroy(StealSet *set);
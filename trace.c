@@ -0,0 +1,155 @@
+/*
+ *  Timeline tracing routines
+ *  Records what every thread is doing and when, for Chrome trace viewers
+ *
+ *  Each thread appends timestamped events to its own ring buffer, so
+ *  recording takes no lock and never contends with other threads. Rings
+ *  are linked into a registry with a compare-and-swap when a thread
+ *  records its first event. After the run, TraceWrite() exports every
+ *  ring as Chrome trace JSON, which chrome://tracing and
+ *  ui.perfetto.dev display as one timeline row per thread.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "latency.h"
+#include "coop.h"
+#include "trace.h"
+
+/**
+ * @file trace.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+static const char *event_names[TRACE_EVENTS] = {
+  "generate", "put", "wait-on-full", "wait-on-empty", "get",
+  "pair search", "multiply", "display", "free", "verify"
+};
+
+/**
+ * @brief One completed activity
+ */
+typedef struct trace_event {
+  long long start;  /**< CLOCK_MONOTONIC nanoseconds */
+  long long dur;    /**< nanoseconds */
+  int event;        /**< TRACE_* */
+} TraceEvent;
+
+/**
+ * @brief Ring of events written only by its owning thread
+ */
+typedef struct trace_ring {
+  int tid;                      /**< small sequential thread id */
+  long long recorded;           /**< total events recorded, ring index is recorded % size */
+  struct trace_ring *next;
+  TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+/** Nonzero once TraceStart() has been called */
+static int tracing = 0;
+static long long epoch = 0;
+static TraceRing *registry = NULL;
+static int next_tid = 1;
+
+static __thread TraceRing *mine = NULL;
+
+/**
+ * @brief Ring of the calling thread, created and registered on first use
+ */
+COOP_TLS_ACCESSOR TraceRing *ring()
+{
+  if (mine == NULL) {
+    TraceRing *r = (TraceRing *)malloc(sizeof(TraceRing));
+    assert(r != NULL);
+    r->recorded = 0;
+    r->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&registry, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&registry, &r->next, r, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+    mine = r;
+  }
+  return mine;
+}
+
+/**
+ * @brief Enables tracing; events are timestamped relative to this call
+ */
+void TraceStart()
+{
+  epoch = LatencyNow();
+  tracing = 1;
+}
+
+/**
+ * @brief Marks the start of an activity
+ *
+ * @return Timestamp to pass to trace_end(), or 0 when tracing is off
+ */
+long long trace_begin()
+{
+  return tracing ? LatencyNow() : 0;
+}
+
+/**
+ * @brief Records an activity that started at start and ends now
+ *
+ * @param event TRACE_* activity
+ * @param start Value returned by trace_begin()
+ */
+void trace_end(int event, long long start)
+{
+  if (start == 0)
+    return;
+  TraceRing *r = ring();
+  TraceEvent *e = &r->events[r->recorded % TRACE_RING_SIZE];
+  e->start = start;
+  e->dur = LatencyNow() - start;
+  e->event = event;
+  r->recorded++;
+}
+
+/**
+ * @brief Writes every recorded event as Chrome trace JSON
+ *
+ * Must be called once the traced threads have finished.
+ *
+ * @param path Output file
+ * @return 0 on success, -1 if the file cannot be written
+ */
+int TraceWrite(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  long long dropped = 0;
+  int first = 1;
+  fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  for (TraceRing *r = __atomic_load_n(&registry, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+    fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+            first ? "" : ",", r->tid, r->tid);
+    first = 0;
+    long long n = r->recorded < TRACE_RING_SIZE ? r->recorded : TRACE_RING_SIZE;
+    dropped += r->recorded - n;
+    for (long long i = r->recorded - n; i < r->recorded; i++) {
+      TraceEvent *e = &r->events[i % TRACE_RING_SIZE];
+      fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+              event_names[e->event], r->tid, (e->start - epoch) / 1e3, e->dur / 1e3);
+    }
+  }
+  fprintf(f, "\n]}\n");
+  if (fclose(f) != 0)
+    return -1;
+  if (dropped > 0)
+    fprintf(stderr, "trace: %lld oldest events were overwritten (ring holds %d per thread)\n",
+            dropped, TRACE_RING_SIZE);
+  return 0;
+}
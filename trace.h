@@ -0,0 +1,32 @@
+/*
+ *  trace header
+ *  Function prototypes, data, and constants for timeline tracing module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// TIMELINE TRACING (Chrome trace / Perfetto JSON)
+
+// Events recorded per thread; the oldest are overwritten once a thread
+// has recorded more than TRACE_RING_SIZE of them
+#define TRACE_RING_SIZE (1 << 16)
+
+// Traced activities
+#define TRACE_GENERATE 0
+#define TRACE_PUT 1
+#define TRACE_WAIT_FULL 2
+#define TRACE_WAIT_EMPTY 3
+#define TRACE_GET 4
+#define TRACE_PAIR_SEARCH 5
+#define TRACE_MULTIPLY 6
+#define TRACE_DISPLAY 7
+#define TRACE_FREE 8
+#define TRACE_VERIFY 9
+#define TRACE_EVENTS 10
+
+// trace methods
+void TraceStart();
+long long trace_begin();
+void trace_end(int event, long long start);
+int TraceWrite(const char *path);
@@ -0,0 +1,288 @@
+/*
+ *  Autotuning routines
+ *  Searches the tunable knobs for the fastest configuration on this host
+ *
+ *  The best worker count, buffer size, batch size, inline slot size and
+ *  consumer kind depend on the core count, the caches and the workload,
+ *  and interact with each other, so they are searched together. Every
+ *  combination starts as a candidate; successive halving then measures
+ *  all candidates with a short run, keeps the best 1 / TUNE_ETA of them
+ *  and measures those again with TUNE_ETA times as many matrices, until
+ *  the last round runs the requested number of matrices. Most of the
+ *  time thus goes to the configurations that matter. Every run of the
+ *  search uses the same seed, so candidates see the same workload.
+ *
+ *  The winner can be saved as a profile, a text file of key=value lines
+ *  that later runs load with TuneLoad() and TuneApply().
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include "matrix.h"
+#include "coop.h"
+#include "pool.h"
+#include "batch.h"
+#include "workload.h"
+#include "pcmatrix.h"
+#include "prodcons.h"
+#include "pipeline.h"
+#include "tune.h"
+
+/**
+ * @file tune.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Orders candidates from the highest score down
+ */
+static int cmp_score(const void *a, const void *b)
+{
+  double x = ((const TuneConfig *)a)->score, y = ((const TuneConfig *)b)->score;
+  return (x < y) - (x > y);
+}
+
+/**
+ * @brief Fills an empty list with default values
+ */
+static void defaults(TuneList *l, const int *v, int n)
+{
+  if (l->n > 0)
+    return;
+  for (int i = 0; i < n && i < TUNE_MAX_VALUES; i++)
+    l->v[l->n++] = v[i];
+}
+
+/**
+ * @brief Measures one configuration
+ *
+ * @return Median matrices per second over TUNE_RUNS runs of the given
+ *         number of matrices, or 0 if the configuration failed
+ */
+static double trial(TuneConfig *c, int matrices, unsigned seed)
+{
+  TuneApply(c);
+  if (BUFFER_ORDER == BUFFER_PRIORITY)
+    AGING = c->buffer_size;
+  PipelineConfig cfg = { c->workers, c->buffer_size, matrices, 0, 0, NULL, NULL, NULL };
+  if (PipelinePoolInit(&cfg) != 0)
+    POOL_MODE = 0;  // the pool cannot be mapped, and will not be for other trials
+  Pipeline *p = PipelineCreate(&cfg);
+  double rates[TUNE_RUNS];
+  int ok = p != NULL;
+  for (int r = 0; r < TUNE_RUNS && ok; r++) {
+    PipelineTotals totals;
+    srand(seed);
+    PipelineRun(p, &totals);
+    ok = totals.prodsum == totals.conssum && totals.produced == totals.consumed && totals.seconds > 0;
+    rates[r] = ok ? totals.consumed / totals.seconds : 0;
+  }
+  if (p != NULL)
+    PipelineDestroy(p);
+  PoolDestroy();
+  if (!ok)
+    return 0;
+  qsort(rates, TUNE_RUNS, sizeof(double), cmp_double);
+  return rates[TUNE_RUNS / 2];
+}
+
+/**
+ * @brief Prints one configuration
+ */
+static void print_config(FILE *stream, const TuneConfig *c)
+{
+  fprintf(stream, "workers=%d buffer=%d batch=%d inline=%d steal=%d --> %.0f matrices/s\n",
+          c->workers, c->buffer_size, c->batch_size, c->inline_max, c->work_stealing, c->score);
+}
+
+/**
+ * @brief Finds the fastest configuration of the knobs for the current workload
+ *
+ * The workload is whatever the producers generate under the current
+ * settings (MATRIX_MODE, WORKLOAD_SPEC, SPARSE_DENSITY); other
+ * engine-wide settings such as EXEC_MODE and BUFFER_ORDER are kept.
+ * BATCH_SIZE, INLINE_MAX and WORK_STEALING are restored on return.
+ *
+ * @param space Values to try; empty lists are filled with defaults for
+ *              the host (workers up to twice the cores) and the workload
+ *              (inline slots only for small matrices; no batching)
+ * @param matrices Matrices per run of the last round
+ * @param seed Seed reset before every run
+ * @param log Stream for a line per round, or NULL
+ * @param best Filled with the winner and its score
+ * @return 0 on success, -1 if no candidate completed a run
+ */
+int TuneSearch(TuneSpace *space, int matrices, unsigned seed, FILE *log, TuneConfig *best)
+{
+  // Largest matrices the workload generates decide which knobs can matter
+  int maxrows = MATRIX_MODE > 0 ? MATRIX_MODE : 4;
+  int maxelems = maxrows * maxrows;
+  if (WORKLOAD_SPEC != NULL)
+    WorkloadBounds(&maxrows, &maxelems);
+
+  int workers[TUNE_MAX_VALUES], nworkers = 0;
+  int cores = coop_default_workers();
+  for (int w = 1; nworkers < TUNE_MAX_VALUES && (w <= 2 * cores || w <= 4); w *= 2)
+    workers[nworkers++] = w;
+  const int buffers[] = { 4, 16, 64, 256, 1024 };
+  const int batches[] = { 0 };  // neutral end to end, see BATCH_SIZE in pcmatrix.h
+  const int inlines[] = { 0, maxelems };
+  const int stealing[] = { 0, 1 };
+  defaults(&space->workers, workers, nworkers);
+  defaults(&space->buffers, buffers, 5);
+  defaults(&space->batches, batches, 1);
+  defaults(&space->inlines, inlines, maxelems <= 256 && SPARSE_DENSITY == 0 ? 2 : 1);
+  defaults(&space->stealing, stealing, 2);
+
+  // Every combination is a candidate, except stealing with batches, which takes precedence over it
+  int n = space->workers.n * space->buffers.n * space->batches.n * space->inlines.n * space->stealing.n;
+  TuneConfig *cands = (TuneConfig *)malloc(sizeof(TuneConfig) * n);
+  assert(cands != NULL);
+  n = 0;
+  for (int w = 0; w < space->workers.n; w++)
+  for (int b = 0; b < space->buffers.n; b++)
+  for (int k = 0; k < space->batches.n; k++)
+  for (int i = 0; i < space->inlines.n; i++)
+  for (int s = 0; s < space->stealing.n; s++) {
+    TuneConfig c = { space->workers.v[w], space->buffers.v[b], space->batches.v[k],
+                     space->inlines.v[i], space->stealing.v[s], 0 };
+    if (c.batch_size > 0 && c.work_stealing)
+      continue;
+    cands[n++] = c;
+  }
+
+  // Rounds needed to get down to one candidate; the last one runs all the matrices
+  int rounds = 0;
+  for (int left = n; left > 1; left = (left + TUNE_ETA - 1) / TUNE_ETA)
+    rounds++;
+  if (rounds == 0)
+    rounds = 1;
+
+  int saved_batch = BATCH_SIZE, saved_inline = INLINE_MAX, saved_steal = WORK_STEALING, saved_aging = AGING;
+  for (int r = 0; r < rounds && n > 0; r++) {
+    int trial_size = matrices;
+    for (int k = r + 1; k < rounds; k++)
+      trial_size /= TUNE_ETA;
+    if (trial_size < TUNE_MIN_TRIAL)
+      trial_size = matrices < TUNE_MIN_TRIAL ? matrices : TUNE_MIN_TRIAL;
+    for (int c = 0; c < n; c++)
+      cands[c].score = trial(&cands[c], trial_size, seed);
+    qsort(cands, n, sizeof(TuneConfig), cmp_score);
+    if (log != NULL) {
+      fprintf(log, "round %d/%d: %d candidate(s) x %d matrices, best ", r + 1, rounds, n, trial_size);
+      print_config(log, &cands[0]);
+      fflush(log);
+    }
+    n = (n + TUNE_ETA - 1) / TUNE_ETA;
+  }
+  BATCH_SIZE = saved_batch;
+  INLINE_MAX = saved_inline;
+  WORK_STEALING = saved_steal;
+  AGING = saved_aging;
+
+  *best = cands[0];
+  free(cands);
+  return best->score > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Sets the engine-wide knobs of a configuration
+ *
+ * workers and buffer_size belong to a pipeline context instead (see
+ * PipelineConfig), and are left to the caller.
+ */
+void TuneApply(const TuneConfig *c)
+{
+  BATCH_SIZE = c->batch_size;
+  INLINE_MAX = c->inline_max;
+  WORK_STEALING = c->work_stealing;
+}
+
+/**
+ * @brief Writes a configuration as a profile
+ *
+ * @return 0 on success, -1 if the file cannot be written
+ */
+int TuneSave(const char *path, const TuneConfig *c)
+{
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  fprintf(f, "# pcMatrix tuned profile (see tune.h)\n");
+  fprintf(f, "# %d core(s), mode %d", coop_default_workers(), MATRIX_MODE);
+  if (WORKLOAD_SPEC != NULL)
+    fprintf(f, ", workload %s", WORKLOAD_SPEC);
+  if (SPARSE_DENSITY > 0)
+    fprintf(f, ", %d%% nonzero", SPARSE_DENSITY);
+  fprintf(f, ": %.0f matrices/s\n", c->score);
+  fprintf(f, "workers=%d\nbuffer=%d\nbatch=%d\ninline=%d\nsteal=%d\n",
+          c->workers, c->buffer_size, c->batch_size, c->inline_max, c->work_stealing);
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Reads a profile written by TuneSave()
+ *
+ * Blank lines and lines starting with '#' are ignored. Knobs the profile
+ * does not set keep the values c holds on entry.
+ *
+ * @return 0 on success, -1 if the file cannot be read or has a bad setting
+ */
+int TuneLoad(const char *path, TuneConfig *c)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  char line[256];
+  int lineno = 0, rc = 0;
+  while (rc == 0 && fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#')
+      continue;
+    char *v = strchr(line, '=');
+    char *end = NULL;
+    long value = 0;
+    if (v != NULL) {
+      *v++ = '\0';
+      value = strtol(v, &end, 10);
+    }
+    if (v == NULL || end == v || *end != '\0' || value < 0)
+      rc = -1;
+    else if (strcmp(line, "workers") == 0 && value >= 1)
+      c->workers = (int)value;
+    else if (strcmp(line, "buffer") == 0 && value >= 1)
+      c->buffer_size = (int)value;
+    else if (strcmp(line, "batch") == 0 && value <= BATCH_MAX)
+      c->batch_size = (int)value;
+    else if (strcmp(line, "inline") == 0)
+      c->inline_max = (int)value;
+    else if (strcmp(line, "steal") == 0 && value <= 1)
+      c->work_stealing = (int)value;
+    else
+      rc = -1;
+    if (rc != 0)
+      fprintf(stderr, "tune: %s:%d: bad setting '%s'\n", path, lineno, line);
+  }
+  fclose(f);
+  return rc;
+}
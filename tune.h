@@ -0,0 +1,58 @@
+/*
+ *  tune header
+ *  Function prototypes, data, and constants for autotuning module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// AUTOTUNING (successive halving over short measured runs)
+
+// Values one knob of the search space can take
+#define TUNE_MAX_VALUES 16
+
+// Candidates kept after each round: the best 1 / TUNE_ETA
+#define TUNE_ETA 2
+
+// Matrices of the shortest trial; trials shorter than this mostly time thread startup
+#define TUNE_MIN_TRIAL 500
+
+// Runs per trial; a trial scores the median throughput of its runs
+#define TUNE_RUNS 3
+
+// One configuration of the tunable knobs, as searched and as saved in a profile
+// workers       - producers, and consumers
+// buffer_size   - capacity of the bounded buffer
+// batch_size    - BATCH_SIZE, 0 for one pair at a time
+// inline_max    - INLINE_MAX, 0 for pointers only
+// work_stealing - WORK_STEALING
+// score         - matrices per second measured in its last trial, 0 if not measured
+typedef struct tune_config {
+  int workers;
+  int buffer_size;
+  int batch_size;
+  int inline_max;
+  int work_stealing;
+  double score;
+} TuneConfig;
+
+// Values the search tries for each knob; a list with n == 0 takes the
+// defaults chosen by TuneSearch() for the host and workload
+typedef struct tune_list {
+  int n;
+  int v[TUNE_MAX_VALUES];
+} TuneList;
+
+typedef struct tune_space {
+  TuneList workers;
+  TuneList buffers;
+  TuneList batches;
+  TuneList inlines;
+  TuneList stealing;
+} TuneSpace;
+
+// tune methods
+int TuneSearch(TuneSpace *space, int matrices, unsigned seed, FILE *log, TuneConfig *best);
+void TuneApply(const TuneConfig *c);
+int TuneSave(const char *path, const TuneConfig *c);
+int TuneLoad(const char *path, TuneConfig *c);
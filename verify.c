@@ -0,0 +1,208 @@
+/*
+ *  Product verification routines
+ *  Checks products with Freivalds' randomized algorithm
+ *
+ *  Recomputing a product to check it costs as much as computing it.
+ *  Freivalds' algorithm instead draws a random 0/1 vector x and checks
+ *  that A1 (A2 (... (An x))) equals C x: a few matrix-vector products,
+ *  O(n^2) work for n x n matrices. A correct product always passes; a
+ *  wrong one passes a round with probability at most 1/2, so rounds
+ *  independent rounds miss an error with probability at most 2^-rounds.
+ *
+ *  Products are computed in wrapping 32-bit arithmetic, which the check
+ *  reproduces with unsigned ints; the bound above holds over any ring.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "matrix.h"
+#include "sparse.h"
+#include "latency.h"
+#include "coop.h"
+#include "verify.h"
+
+/**
+ * @file verify.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/** Fraction of products checked and rounds per check */
+static double sample_rate = 0;
+static int nrounds = DEFAULT_VERIFY_ROUNDS;
+
+/** Source of every check's random stream */
+static unsigned long long draws = 0;
+
+/** Totals for VerifyReport() */
+static long products = 0;
+static long checked = 0;
+static long failed = 0;
+static long long check_ns = 0;
+
+/**
+ * @brief splitmix64 step, a fast generator independent of rand()
+ *
+ * Verification must not draw from rand(), which would change the
+ * matrices producers generate.
+ */
+static unsigned long long next_random(unsigned long long *state)
+{
+  unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * @brief Sets how many products are checked and how thoroughly
+ *
+ * @param rate Fraction of products checked, 0 to 1
+ * @param rounds Rounds per check
+ */
+void VerifyInit(double rate, int rounds)
+{
+  sample_rate = rate;
+  nrounds = rounds;
+  draws = (unsigned long long)LatencyNow();
+  products = checked = failed = 0;
+  check_ns = 0;
+}
+
+/**
+ * @brief y = M x in wrapping 32-bit arithmetic, dense or CSR
+ */
+static void matvec(Matrix *mat, const unsigned *x, unsigned *y)
+{
+  if (mat->csr != NULL) {
+    Csr *s = mat->csr;
+    for (int i = 0; i < mat->rows; i++) {
+      unsigned sum = 0;
+      for (int p = s->rowptr[i]; p < s->rowptr[i + 1]; p++)
+        sum += (unsigned)s->vals[p] * x[s->colidx[p]];
+      y[i] = sum;
+    }
+    return;
+  }
+  for (int i = 0; i < mat->rows; i++) {
+    const int *row = mat->m[i];
+    unsigned sum = 0;
+    for (int j = 0; j < mat->cols; j++)
+      sum += (unsigned)row[j] * x[j];
+    y[i] = sum;
+  }
+}
+
+/**
+ * @brief Draws whether the next product is checked
+ *
+ * Counts the product and samples it with the rate given to VerifyInit().
+ * Consumers that only compute a product when it is to be checked (see
+ * LAZY_PRODUCTS) draw before multiplying, then call VerifyCheck().
+ *
+ * @param seed Set to the seed of the check's random vectors if it is sampled
+ * @return 1 if the product is to be checked, 0 if it passes unchecked
+ */
+int VerifySample(unsigned long long *seed)
+{
+  __atomic_fetch_add(&products, 1, __ATOMIC_RELAXED);
+  unsigned long long state = __atomic_fetch_add(&draws, 1, __ATOMIC_RELAXED);
+  *seed = state;
+  return sample_rate >= 1 || (next_random(&state) >> 11) * 0x1.0p-53 < sample_rate;
+}
+
+/**
+ * @brief Checks a sampled product of a chain of factors with Freivalds' algorithm
+ *
+ * Each product is sampled with the rate given to VerifyInit(); unsampled
+ * products pass unchecked.
+ *
+ * @param factors Factors A1 .. An, each Ai's columns the rows of Ai+1
+ * @param n Number of factors (2 for a pair)
+ * @param product Computed product to check
+ * @return 1 if the product passed or was not sampled, 0 if it is wrong
+ */
+int VerifyProduct(Matrix **factors, int n, Matrix *product)
+{
+  unsigned long long seed;
+  if (!VerifySample(&seed))
+    return 1;
+  return VerifyCheck(factors, n, product, seed);
+}
+
+/**
+ * @brief Checks a product drawn by VerifySample() with Freivalds' algorithm
+ *
+ * @param factors Factors A1 .. An, each Ai's columns the rows of Ai+1
+ * @param n Number of factors (2 for a pair)
+ * @param product Computed product to check
+ * @param seed Seed set by VerifySample()
+ * @return 1 if the product passed, 0 if it is wrong
+ */
+int VerifyCheck(Matrix **factors, int n, Matrix *product, unsigned long long seed)
+{
+  unsigned long long state = seed;
+  if (sample_rate < 1)
+    next_random(&state);  // past the sampling draw
+  long long start = LatencyNow();
+  // Longest vector any step needs: the columns or rows of some factor
+  int len = product->cols;
+  for (int f = 0; f < n; f++)
+    if (factors[f]->rows > len)
+      len = factors[f]->rows;
+  unsigned *x = (unsigned *)coop_scratch(sizeof(unsigned) * (2 * (size_t)len + product->rows));
+  unsigned *y = x + len, *cx = y + len;
+
+  int ok = 1;
+  for (int round = 0; round < nrounds && ok; round++) {
+    // Random 0/1 vector, 64 elements per draw
+    unsigned long long bits = 0;
+    for (int j = 0; j < product->cols; j++) {
+      if (j % 64 == 0)
+        bits = next_random(&state);
+      x[j] = (bits >> (j % 64)) & 1;
+    }
+    matvec(product, x, cx);
+
+    // The factors applied right to left, alternating between x and y
+    unsigned *in = x, *out = y;
+    for (int f = n - 1; f >= 0; f--) {
+      matvec(factors[f], in, out);
+      unsigned *t = in;
+      in = out;
+      out = t;
+    }
+    ok = memcmp(in, cx, sizeof(unsigned) * product->rows) == 0;
+  }
+  free(x);
+
+  __atomic_fetch_add(&checked, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&check_ns, LatencyNow() - start, __ATOMIC_RELAXED);
+  if (!ok && __atomic_fetch_add(&failed, 1, __ATOMIC_RELAXED) < VERIFY_MAX_REPORTED)
+    fprintf(stderr, "verify: product (%d x %d) of %d factors failed Freivalds' check\n",
+            product->rows, product->cols, n);
+  return ok;
+}
+
+/**
+ * @brief Prints how many products were checked, how many failed, and the cost
+ *
+ * @param consumer_seconds Time consumers ran, which the overhead is compared with (0: not compared)
+ */
+void VerifyReport(FILE *stream, double consumer_seconds)
+{
+  fprintf(stream, "Verification --> checked=%ld of %ld products (%d rounds) failed=%ld\n",
+          checked, products, nrounds, failed);
+  fprintf(stream, "Verification overhead --> %.3f ms (%.2f us per check",
+          check_ns / 1e6, checked > 0 ? check_ns / 1e3 / checked : 0.0);
+  if (consumer_seconds > 0)
+    fprintf(stream, ", %.2f%% of consumer time", 100.0 * check_ns / 1e9 / consumer_seconds);
+  fprintf(stream, ")\n");
+}
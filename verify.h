@@ -0,0 +1,23 @@
+/*
+ *  verify header
+ *  Function prototypes, data, and constants for product verification module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// PRODUCT VERIFICATION (Freivalds' randomized check)
+
+// Default rounds per check; a wrong product passes all of them with
+// probability at most 2^-rounds
+#define DEFAULT_VERIFY_ROUNDS 10
+
+// Failed checks printed to stderr before only counting them
+#define VERIFY_MAX_REPORTED 10
+
+// verify methods
+void VerifyInit(double rate, int rounds);
+int VerifyProduct(Matrix **factors, int n, Matrix *product);
+int VerifySample(unsigned long long *seed);
+int VerifyCheck(Matrix **factors, int n, Matrix *product, unsigned long long seed);
+void VerifyReport(FILE *stream, double consumer_seconds);
@@ -0,0 +1,357 @@
+/*
+ *  Workload generator routines
+ *  Produces matrices following a configurable shape and value mix
+ *
+ *  GenMatrixRandom() only knows uniform 1-4 shapes (mode 0) and fixed
+ *  N x N squares. A workload specification (see workload.h) describes a
+ *  weighted mix of shape classes instead, each with its own row and
+ *  column ranges or aspect ratio, uniform or heavy-tailed size
+ *  distribution and element value range, plus the rate at which
+ *  consecutive matrices are compatible for multiplication.
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// Include only libraries for this module
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "matrix.h"
+#include "sparse.h"
+#include "pcmatrix.h"
+#include "workload.h"
+
+/**
+ * @file workload.c
+ * @author Jeremiah Brenio, Luke Chung
+ * @date Feb 2025
+ * @note AI was used to help document code.
+ */
+
+/**
+ * @brief Distribution of one dimension over [lo, hi]
+ */
+typedef struct dim_dist {
+  int lo, hi;
+  int kind;       /**< DIST_* */
+  double alpha;   /**< tail exponent */
+  double *cdf;    /**< zipf: cumulative probabilities of lo .. hi */
+} DimDist;
+
+/**
+ * @brief One shape class of the mix
+ */
+typedef struct shape_class {
+  double weight;
+  DimDist rows;
+  DimDist cols;
+  double aspect;  /**< > 0: cols = rows x aspect instead of sampling cols */
+  int vlo, vhi;   /**< element values */
+} ShapeClass;
+
+static ShapeClass classes[WORKLOAD_MAX_CLASSES];
+static int nclasses = 0;
+static int match_pct = -1;
+
+/** Columns of the previous matrix; WorkloadMatrix() runs under the buffer lock */
+static int last_cols = 0;
+
+/**
+ * @brief Uniform random number in [0, 1)
+ */
+static double uniform()
+{
+  return rand() / (RAND_MAX + 1.0);
+}
+
+/**
+ * @brief Parses "A" or "A-B" into a positive range
+ */
+static int parse_range(const char *v, int *lo, int *hi)
+{
+  char *end;
+  *lo = (int)strtol(v, &end, 10);
+  *hi = *lo;
+  if (*end == '-')
+    *hi = (int)strtol(end + 1, &end, 10);
+  return *end == '\0' && *lo <= *hi ? 0 : -1;
+}
+
+/**
+ * @brief Precomputes what sampling a dimension needs
+ */
+static void prepare(DimDist *d)
+{
+  d->cdf = NULL;
+  if (d->kind != DIST_ZIPF)
+    return;
+  int n = d->hi - d->lo + 1;
+  d->cdf = (double *)malloc(sizeof(double) * n);
+  assert(d->cdf != NULL);
+  double sum = 0;
+  for (int k = 0; k < n; k++) {
+    sum += pow(k + 1, -d->alpha);
+    d->cdf[k] = sum;
+  }
+  for (int k = 0; k < n; k++)
+    d->cdf[k] /= sum;
+}
+
+/**
+ * @brief Draws one value of a dimension
+ */
+static int sample(DimDist *d)
+{
+  if (d->lo == d->hi)
+    return d->lo;
+  double u = uniform();
+  if (d->kind == DIST_ZIPF) {
+    // binary search of the cumulative distribution
+    int lo = 0, hi = d->hi - d->lo;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (d->cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return d->lo + lo;
+  }
+  if (d->kind == DIST_PARETO) {
+    // inverse CDF of a Pareto distribution truncated to [lo, hi + 1)
+    double l = d->lo, h = d->hi + 1.0;
+    double x = l / pow(1 - u * (1 - pow(l / h, d->alpha)), 1 / d->alpha);
+    int v = (int)x;
+    return v > d->hi ? d->hi : v;
+  }
+  return d->lo + (int)(u * (d->hi - d->lo + 1));
+}
+
+/**
+ * @brief Parses one ','-separated class of the specification
+ *
+ * @return 0 on success, -1 on a malformed setting
+ */
+static int parse_class(char *text)
+{
+  ShapeClass c;
+  c.weight = 1;
+  c.rows.lo = 1;
+  c.rows.hi = 4;
+  c.rows.kind = DIST_UNIFORM;
+  c.rows.alpha = 1.2;
+  c.aspect = 0;
+  c.vlo = 1;
+  c.vhi = 10;
+  int has_cols = 0, shaped = 0;
+  char *saveptr;
+  for (char *kv = strtok_r(text, ",", &saveptr); kv != NULL; kv = strtok_r(NULL, ",", &saveptr)) {
+    char *v = strchr(kv, '=');
+    if (v == NULL) {
+      fprintf(stderr, "workload: expected key=value, got '%s'\n", kv);
+      return -1;
+    }
+    *v++ = '\0';
+    int rc = 0;
+    if (strcmp(kv, "match") == 0) {
+      match_pct = atoi(v);
+      rc = match_pct < 0 || match_pct > 100 ? -1 : 0;
+    }
+    else if (strcmp(kv, "w") == 0) {
+      c.weight = atof(v);
+      rc = c.weight > 0 ? 0 : -1;
+    }
+    else if (strcmp(kv, "rows") == 0)
+      rc = parse_range(v, &c.rows.lo, &c.rows.hi);
+    else if (strcmp(kv, "cols") == 0) {
+      rc = parse_range(v, &c.cols.lo, &c.cols.hi);
+      has_cols = 1;
+    }
+    else if (strcmp(kv, "aspect") == 0) {
+      c.aspect = atof(v);
+      rc = c.aspect > 0 ? 0 : -1;
+    }
+    else if (strcmp(kv, "dist") == 0) {
+      if (strcmp(v, "uniform") == 0)
+        c.rows.kind = DIST_UNIFORM;
+      else if (strcmp(v, "zipf") == 0)
+        c.rows.kind = DIST_ZIPF;
+      else if (strcmp(v, "pareto") == 0)
+        c.rows.kind = DIST_PARETO;
+      else
+        rc = -1;
+    }
+    else if (strcmp(kv, "alpha") == 0) {
+      c.rows.alpha = atof(v);
+      rc = c.rows.alpha > 0 ? 0 : -1;
+    }
+    else if (strcmp(kv, "vals") == 0)
+      rc = parse_range(v, &c.vlo, &c.vhi);
+    else
+      rc = -1;
+    if (rc != 0) {
+      fprintf(stderr, "workload: bad setting '%s=%s'\n", kv, v);
+      return -1;
+    }
+    shaped |= strcmp(kv, "match") != 0;
+  }
+  if (!shaped)
+    return 0;  // a clause with only workload-wide settings
+  if (c.rows.lo < 1 || (has_cols && c.cols.lo < 1)) {
+    fprintf(stderr, "workload: dimensions must be at least 1\n");
+    return -1;
+  }
+  if (nclasses == WORKLOAD_MAX_CLASSES) {
+    fprintf(stderr, "workload: more than %d classes\n", WORKLOAD_MAX_CLASSES);
+    return -1;
+  }
+  // Columns follow the rows distribution over their own range
+  int clo = has_cols ? c.cols.lo : c.rows.lo;
+  int chi = has_cols ? c.cols.hi : c.rows.hi;
+  c.cols = c.rows;
+  c.cols.lo = clo;
+  c.cols.hi = chi;
+  prepare(&c.rows);
+  prepare(&c.cols);
+  classes[nclasses++] = c;
+  return 0;
+}
+
+/**
+ * @brief Picks a class by weight among those whose row range holds rows
+ *
+ * @param rows Required row count, or 0 to pick among every class
+ * @return Class, or NULL if no class allows that many rows
+ */
+static ShapeClass *pick_class(int rows)
+{
+  double total = 0;
+  for (int i = 0; i < nclasses; i++)
+    if (rows == 0 || (classes[i].rows.lo <= rows && rows <= classes[i].rows.hi))
+      total += classes[i].weight;
+  if (total == 0)
+    return NULL;
+  double pick = uniform() * total;
+  ShapeClass *c = NULL;
+  for (int i = 0; i < nclasses; i++) {
+    if (rows != 0 && (classes[i].rows.lo > rows || rows > classes[i].rows.hi))
+      continue;
+    c = &classes[i];
+    if (pick < c->weight)
+      break;
+    pick -= c->weight;
+  }
+  return c;
+}
+
+/**
+ * @brief Parses a workload specification; WorkloadMatrix() then follows it
+ *
+ * @param spec Specification, see workload.h
+ * @return 0 on success, -1 if the specification is malformed
+ */
+int WorkloadInit(const char *spec)
+{
+  WorkloadDestroy();
+  char *copy = strdup(spec);
+  char *saveptr;
+  int rc = 0;
+  for (char *cls = strtok_r(copy, ";", &saveptr); cls != NULL && rc == 0; cls = strtok_r(NULL, ";", &saveptr))
+    rc = parse_class(cls);
+  free(copy);
+  if (rc == 0 && nclasses == 0) {
+    fprintf(stderr, "workload: no shape class in '%s'\n", spec);
+    rc = -1;
+  }
+  if (rc != 0)
+    WorkloadDestroy();
+  return rc;
+}
+
+/**
+ * @brief Generates the next matrix of the workload
+ *
+ * Not thread safe: producers call it under the buffer lock, which also
+ * keeps the pair steering in buffer order.
+ *
+ * @return New matrix, stored sparsely if SPARSE_DENSITY calls for it
+ */
+Matrix *WorkloadMatrix()
+{
+  // A steered matrix continues the previous one, preferably from a class
+  // allowing that many rows; its columns always come from its class
+  int steer = match_pct > 0 && last_cols > 0 && rand() % 100 < match_pct;
+  ShapeClass *c = steer ? pick_class(last_cols) : NULL;
+  if (c == NULL)
+    c = pick_class(0);
+  int rows = steer ? last_cols : sample(&c->rows);
+  int cols;
+  if (c->aspect > 0) {
+    // capped at the class's own largest width so steering cannot grow shapes
+    int widest = (int)lround(c->rows.hi * c->aspect);
+    cols = (int)lround(rows * c->aspect);
+    if (cols > widest)
+      cols = widest;
+    if (cols < 1)
+      cols = 1;
+  }
+  else {
+    cols = sample(&c->cols);
+  }
+  last_cols = cols;
+
+  Matrix *mat = AllocMatrix(rows, cols);
+  int span = c->vhi - c->vlo + 1;
+  for (int i = 0; i < rows; i++) {
+    int *row = mat->m[i];
+    for (int j = 0; j < cols; j++) {
+      if (SPARSE_DENSITY > 0 && SPARSE_DENSITY < 100 && rand() % 100 >= SPARSE_DENSITY)
+        row[j] = 0;
+      else
+        row[j] = c->vlo + rand() % span;
+    }
+  }
+  if (SPARSE_DENSITY > 0)
+    mat = ChooseStorage(mat);
+  return mat;
+}
+
+/**
+ * @brief Largest row count and element count the workload can generate
+ */
+void WorkloadBounds(int *maxrows, int *maxelems)
+{
+  int rows = 0, cols = 0;
+  for (int i = 0; i < nclasses; i++) {
+    ShapeClass *c = &classes[i];
+    int widest = c->aspect > 0 ? (int)lround(c->rows.hi * c->aspect) : c->cols.hi;
+    if (widest < 1)
+      widest = 1;
+    if (c->rows.hi > rows)
+      rows = c->rows.hi;
+    if (widest > cols)
+      cols = widest;
+  }
+  // steered matrices take their rows from some matrix's columns
+  if (match_pct > 0 && cols > rows)
+    rows = cols;
+  *maxrows = rows;
+  *maxelems = rows * cols;
+}
+
+/**
+ * @brief Forgets the current specification
+ */
+void WorkloadDestroy()
+{
+  for (int i = 0; i < nclasses; i++) {
+    free(classes[i].rows.cdf);
+    free(classes[i].cols.cdf);
+  }
+  nclasses = 0;
+  match_pct = -1;
+  last_cols = 0;
+}
@@ -0,0 +1,39 @@
+/*
+ *  workload header
+ *  Function prototypes, data, and constants for workload generator module
+ *
+ *  University of Washington, Tacoma
+ *  TCSS 422 - Operating Systems
+ */
+
+// WORKLOAD GENERATOR (configurable shape and value distributions)
+//
+// A specification is a ';' separated mix of shape classes, each a ','
+// separated list of key=value settings:
+//   w=N          relative weight of the class in the mix (default 1)
+//   rows=A[-B]   row count range (default 1-4)
+//   cols=A[-B]   column count range (default: the rows range)
+//   aspect=R     columns = rows x R instead of a cols range (1 for squares),
+//                at most the class's largest rows x R
+//   dist=D       size distribution over the ranges: uniform (default),
+//                zipf or pareto, both heavy-tailed toward the small end
+//   alpha=X      tail exponent of zipf and pareto (default 1.2)
+//   vals=A[-B]   element value range (default 1-10)
+//   match=P      percent of matrices whose rows equal the previous
+//                matrix's columns, so consumers find compatible pairs at
+//                about that rate (whole workload; default: no steering)
+// e.g. "w=8,rows=1-16,dist=zipf;w=2,rows=64-256,aspect=0.5;match=60"
+
+// Maximum number of shape classes in one specification
+#define WORKLOAD_MAX_CLASSES 16
+
+// Size distributions
+#define DIST_UNIFORM 0
+#define DIST_ZIPF 1
+#define DIST_PARETO 2
+
+// workload methods
+int WorkloadInit(const char *spec);
+Matrix * WorkloadMatrix();
+void WorkloadBounds(int *maxrows, int *maxelems);
+void WorkloadDestroy();